@@ -0,0 +1,147 @@
+// The Arduino core and AVR hardware behind the include/ stand-ins: registers,
+// the simulated clock, Print, the EEPROM and the u8glib delays.
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <util/delay.h>
+
+#include "sim.h"
+
+/** registers **/
+
+#define SIM_PORT(x) sim_port_t PORT ## x; volatile uint8_t PIN ## x, DDR ## x;
+SIM_PORT(A) SIM_PORT(B) SIM_PORT(C) SIM_PORT(D) SIM_PORT(E) SIM_PORT(F)
+SIM_PORT(G) SIM_PORT(H) SIM_PORT(J) SIM_PORT(K) SIM_PORT(L)
+
+void sim_port_t::set(uint8_t v)
+{
+  uint8_t old_value = value;
+  value = v;
+  if (v != old_value) sim_display_port_changed(this, old_value);
+}
+
+volatile uint8_t SREG;
+
+sim_udr_t UDR0;
+sim_ucsra_t UCSR0A;
+volatile uint8_t UCSR0B, UBRR0H, UBRR0L;
+
+sim_udr_t &sim_udr_t::operator=(uint8_t c)
+{
+  fputc(c, stderr);
+  return *this;
+}
+
+/** clock **/
+
+static unsigned long sim_us = 0;
+
+// The timer interrupt runs for every millisecond the clock passes, also while
+// the firmware waits in a delay of the display driver
+void sim_advance_us(unsigned long us)
+{
+  static bool in_interrupt = false;
+  unsigned long ms = sim_us / 1000;
+  sim_us += us;
+  if (in_interrupt) return;
+  in_interrupt = true;
+  while (ms++ < sim_us / 1000) sim_firmware_interrupt();
+  in_interrupt = false;
+}
+
+unsigned long millis(void) { return sim_us / 1000; }
+unsigned long micros(void) { return sim_us; }
+void delay(unsigned long ms) { sim_advance_us(ms * 1000); }
+void delayMicroseconds(unsigned int us) { sim_advance_us(us); }
+
+/** pins by Arduino number: the beeper and the backlight, nothing to show **/
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t val) {}
+int digitalRead(uint8_t pin) { return HIGH; }
+int analogRead(uint8_t pin) { return 0; }
+void analogWrite(uint8_t pin, int val) {}
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration) {}
+void noTone(uint8_t pin) {}
+
+/** Print **/
+
+size_t Print::write(const char *str)
+{
+  size_t n = 0;
+  while (*str) n += write((uint8_t)*str++);
+  return n;
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::print(long n, int base)
+{
+  if (n < 0 && base == DEC)
+    return write('-') + print((unsigned long)-n, base);
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2) base = 10;
+  do {
+    unsigned long m = n;
+    n /= base;
+    char c = m - base * n;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+  return write(str);
+}
+
+size_t Print::print(double number, int digits)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", digits, number);
+  return write(buf);
+}
+
+/** EEPROM **/
+
+static uint8_t sim_eeprom[E2END + 1];
+
+uint8_t eeprom_read_byte(const uint8_t *addr)
+{
+  return sim_eeprom[(uintptr_t)addr & E2END];
+}
+
+uint16_t eeprom_read_word(const uint16_t *addr)
+{
+  return eeprom_read_byte((const uint8_t *)addr) | eeprom_read_byte((const uint8_t *)addr + 1) << 8;
+}
+
+void eeprom_write_byte(uint8_t *addr, uint8_t value)
+{
+  sim_eeprom[(uintptr_t)addr & E2END] = value;
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+  for (size_t i = 0; i < n; i++) ((uint8_t *)dst)[i] = eeprom_read_byte((const uint8_t *)src + i);
+}
+
+void eeprom_write_block(const void *src, void *dst, size_t n)
+{
+  for (size_t i = 0; i < n; i++) eeprom_write_byte((uint8_t *)dst + i, ((const uint8_t *)src)[i]);
+}
+
+/** u8glib delays, in place of u8g_delay.c **/
+
+extern "C" {
+void u8g_Delay(uint16_t val) { sim_advance_us(val * 1000UL); }
+void u8g_MicroDelay(void) { sim_advance_us(1); }
+void u8g_10MicroDelay(void) { sim_advance_us(10); }
+}
@@ -0,0 +1,422 @@
+// The display controllers behind the firmware: an ST7565 on the u8glib com
+// layer, an ST7920 decoded from the bit-banged pins of the RRD driver, and an
+// HD44780 behind LiquidCrystal. Each keeps its own RAM the way the glass does,
+// the renderers read the picture back out of it.
+
+#include <string.h>
+#include <stdlib.h>
+#include <LiquidCrystal.h>
+#include <u8g.h>
+
+#include "sim.h"
+
+#define SIM_WIDTH 128
+#define SIM_HEIGHT 64
+
+enum sim_display_t { SIM_NONE, SIM_ST7565, SIM_ST7920, SIM_HD44780 };
+
+static sim_display_t sim_display = SIM_NONE;
+static unsigned long sim_bytes = 0;
+
+unsigned long sim_display_bytes() { return sim_bytes; }
+
+/** ST7565 **/
+
+static struct
+{
+  uint8_t ram[8][132];    // 8 pages of 8 rows, one byte per column, LSB on top
+  uint8_t first_column;   // RAM column of the left edge of the glass
+  bool upside_down;       // the glass is mounted turned by 180 degrees
+  uint8_t page, column;
+  bool data;              // A0 high
+  bool selected;
+  bool on, inverse, all_points;
+  bool contrast_next;     // the byte after 0x81 is the contrast value
+} st7565;
+
+void sim_st7565_attach(uint8_t first_column, bool upside_down)
+{
+  memset(&st7565, 0, sizeof(st7565));
+  st7565.first_column = first_column;
+  st7565.upside_down = upside_down;
+  sim_display = SIM_ST7565;
+}
+
+static void st7565_write(uint8_t b)
+{
+  if (!st7565.selected) return;
+  sim_bytes++;
+  if (st7565.data)
+  {
+    if (st7565.column < sizeof(st7565.ram[0])) st7565.ram[st7565.page][st7565.column] = b;
+    st7565.column++;
+    return;
+  }
+  if (st7565.contrast_next) { st7565.contrast_next = false; return; }
+  if ((b & 0xF0) == 0xB0) st7565.page = b & 0x07;
+  else if ((b & 0xF0) == 0x10) st7565.column = (st7565.column & 0x0F) | (b & 0x0F) << 4;
+  else if ((b & 0xF0) == 0x00) st7565.column = (st7565.column & 0xF0) | (b & 0x0F);
+  else if (b == 0xA6 || b == 0xA7) st7565.inverse = b & 1;
+  else if (b == 0xA4 || b == 0xA5) st7565.all_points = b & 1;
+  else if (b == 0xAE || b == 0xAF) st7565.on = b & 1;
+  else if (b == 0x81) st7565.contrast_next = true;
+  else if (b == 0xF8 || b == 0xAC) st7565.contrast_next = true; // booster ratio and indicator take a value byte too
+  // start line, ADC, COM direction, bias and power are fixed for the Marlin panels
+}
+
+static bool st7565_pixel(int x, int y)
+{
+  if (!st7565.on) return false;
+  if (st7565.all_points) return true;
+  if (st7565.upside_down) { x = SIM_WIDTH - 1 - x; y = SIM_HEIGHT - 1 - y; }
+  bool on = st7565.ram[y / 8][st7565.first_column + x] & (1 << (y % 8));
+  return on != st7565.inverse;
+}
+
+// Without a com driver for the host, u8g.h sends every HW SPI device here
+extern "C" uint8_t u8g_com_null_fn(u8g_t *u8g, uint8_t msg, uint8_t arg_val, void *arg_ptr)
+{
+  if (sim_display != SIM_ST7565) return 1;
+  switch (msg)
+  {
+    case U8G_COM_MSG_ADDRESS:
+      st7565.data = arg_val;
+      break;
+    case U8G_COM_MSG_CHIP_SELECT:
+      st7565.selected = arg_val;
+      break;
+    case U8G_COM_MSG_WRITE_BYTE:
+      st7565_write(arg_val);
+      break;
+    case U8G_COM_MSG_WRITE_SEQ:
+    case U8G_COM_MSG_WRITE_SEQ_P:
+      for (uint8_t i = 0; i < arg_val; i++) st7565_write(((const uint8_t *)arg_ptr)[i]);
+      break;
+  }
+  return 1;
+}
+
+/** ST7920 **/
+
+static struct st7920_t
+{
+  sim_output_t cs, clk, dat;
+  uint8_t gdram[32][32];  // 32 rows of 16 words, the lower half of the glass is in words 8..15
+  uint8_t shift, bits;    // serial input
+  bool synced, data;      // after a 0xF8 / 0xFA sync byte
+  bool half;              // the high nibble has arrived
+  uint8_t high;
+  bool extended, graphic, on;
+  bool y_next;            // the next 0x80 command sets y, the one after it x
+  uint8_t x, y;
+} st7920;
+
+void sim_st7920_attach(sim_output_t cs, sim_output_t clk, sim_output_t dat)
+{
+  st7920 = st7920_t();
+  st7920.cs = cs;
+  st7920.clk = clk;
+  st7920.dat = dat;
+  st7920.y_next = true;
+  sim_display = SIM_ST7920;
+}
+
+static void st7920_command(uint8_t b)
+{
+  if ((b & 0xE0) == 0x20) // function set
+  {
+    st7920.extended = b & 0x04;
+    st7920.graphic = b & 0x02;
+  }
+  else if (b & 0x80)
+  {
+    if (!st7920.extended) return; // DDRAM address, text mode is not used
+    if (st7920.y_next) st7920.y = b & 0x1F;
+    else st7920.x = (b & 0x0F) * 2;
+    st7920.y_next = !st7920.y_next;
+  }
+  else if ((b & 0xF8) == 0x08)
+    st7920.on = b & 0x04;
+}
+
+static void st7920_byte(uint8_t b)
+{
+  if (b & 0x0F) // only sync bytes have bits in the low nibble
+  {
+    st7920.synced = true;
+    st7920.data = b & 0x02;
+    st7920.half = false;
+    return;
+  }
+  if (!st7920.synced) return;
+  if (!st7920.half)
+  {
+    st7920.high = b;
+    st7920.half = true;
+    return;
+  }
+  st7920.half = false;
+  b = st7920.high | b >> 4;
+  sim_bytes++;
+  if (!st7920.data)
+    st7920_command(b);
+  else
+  {
+    st7920.y_next = true;
+    if (st7920.x < sizeof(st7920.gdram[0])) st7920.gdram[st7920.y][st7920.x] = b;
+    st7920.x++;
+  }
+}
+
+static bool st7920_pixel(int x, int y)
+{
+  if (!st7920.on || !st7920.graphic) return false;
+  int col = x / 8 + (y < 32 ? 0 : 16);
+  return st7920.gdram[y % 32][col] & (0x80 >> (x % 8));
+}
+
+void sim_display_port_changed(sim_port_t *port, uint8_t old_value)
+{
+  if (sim_display != SIM_ST7920) return;
+  if (port == st7920.cs.port && (old_value ^ port->value) & st7920.cs.mask)
+  {
+    st7920.bits = 0; // the serial interface restarts on every chip select
+    st7920.synced = false;
+  }
+  if (port == st7920.clk.port && !(old_value & st7920.clk.mask) && (port->value & st7920.clk.mask))
+  {
+    if (!(st7920.cs.port->value & st7920.cs.mask)) return;
+    st7920.shift = st7920.shift << 1 | ((st7920.dat.port->value & st7920.dat.mask) ? 1 : 0);
+    if (++st7920.bits == 8)
+    {
+      st7920.bits = 0;
+      st7920_byte(st7920.shift);
+    }
+  }
+}
+
+/** HD44780 **/
+
+static struct
+{
+  uint8_t ddram[128];
+  uint8_t cgram[64];
+  uint8_t cols, rows;
+  uint8_t addr;
+  bool cg;                // the address points into the CGRAM
+  bool on;
+} hd44780;
+
+static const uint8_t hd44780_row_offsets[] = { 0x00, 0x40, 0x14, 0x54 };
+
+void LiquidCrystal::begin(uint8_t cols, uint8_t rows)
+{
+  memset(&hd44780, 0, sizeof(hd44780));
+  memset(hd44780.ddram, ' ', sizeof(hd44780.ddram));
+  hd44780.cols = cols;
+  hd44780.rows = rows > 4 ? 4 : rows;
+  hd44780.on = true;
+  sim_display = SIM_HD44780;
+}
+
+void LiquidCrystal::clear() { command(0x01); }
+void LiquidCrystal::home() { command(0x02); }
+
+void LiquidCrystal::setCursor(uint8_t col, uint8_t row)
+{
+  if (row >= hd44780.rows) row = hd44780.rows - 1;
+  command(0x80 | (col + hd44780_row_offsets[row]));
+}
+
+void LiquidCrystal::createChar(uint8_t location, uint8_t charmap[])
+{
+  command(0x40 | (location & 0x07) << 3);
+  for (uint8_t i = 0; i < 8; i++) write(charmap[i]);
+}
+
+void LiquidCrystal::command(uint8_t value)
+{
+  sim_bytes++;
+  if (value & 0x80) { hd44780.addr = value & 0x7F; hd44780.cg = false; }
+  else if (value & 0x40) { hd44780.addr = value & 0x3F; hd44780.cg = true; }
+  else if (value & 0x08) hd44780.on = value & 0x04;
+  else if (value & 0x02) { hd44780.addr = 0; hd44780.cg = false; }
+  else if (value & 0x01)
+  {
+    memset(hd44780.ddram, ' ', sizeof(hd44780.ddram));
+    hd44780.addr = 0;
+    hd44780.cg = false;
+  }
+}
+
+size_t LiquidCrystal::write(uint8_t value)
+{
+  sim_bytes++;
+  if (hd44780.cg)
+    hd44780.cgram[hd44780.addr++ & 0x3F] = value;
+  else
+    hd44780.ddram[hd44780.addr++ & 0x7F] = value;
+  return 1;
+}
+
+// The character ROM is not simulated, the glyphs print as their closest UTF-8 look-alike
+static void hd44780_print_char(FILE *out, uint8_t c)
+{
+  static const char *const custom[] = { "⁰", "¹", "²", "³", "⁴", "⁵", "⁶", "⁷" };
+  if (c < 16) fputs(custom[c & 7], out);
+  else if (c == 0x7E) fputs("→", out);
+  else if (c == 0x7F) fputs("←", out);
+  else if (c == 0xDF) fputs("°", out);
+  else if (c >= ' ' && c < 0x7E) fputc(c, out);
+  else fputc('?', out);
+}
+
+static void hd44780_print(FILE *out, bool ansi)
+{
+  fputc('+', out);
+  for (uint8_t c = 0; c < hd44780.cols; c++) fputc('-', out);
+  fputs("+\n", out);
+  for (uint8_t r = 0; r < hd44780.rows; r++)
+  {
+    fputc('|', out);
+    if (ansi) fputs("\033[30;42m", out);
+    for (uint8_t c = 0; c < hd44780.cols; c++)
+    {
+      if (hd44780.on) hd44780_print_char(out, hd44780.ddram[(hd44780_row_offsets[r] + c) & 0x7F]);
+      else fputc(' ', out);
+    }
+    if (ansi) fputs("\033[0m", out);
+    fputs("|\n", out);
+  }
+  fputc('+', out);
+  for (uint8_t c = 0; c < hd44780.cols; c++) fputc('-', out);
+  fputs("+\n", out);
+}
+
+/** rendering **/
+
+static bool sim_pixel(int x, int y)
+{
+  switch (sim_display)
+  {
+    case SIM_ST7565: return st7565_pixel(x, y);
+    case SIM_ST7920: return st7920_pixel(x, y);
+    default: return false;
+  }
+}
+
+// Two pixel rows per line of text, in half blocks
+void sim_display_print(FILE *out, bool ansi)
+{
+  if (sim_display == SIM_HD44780) { hd44780_print(out, ansi); return; }
+
+  static const char *const blocks[] = { " ", "▀", "▄", "█" };
+  fputc('+', out);
+  for (int x = 0; x < SIM_WIDTH; x++) fputc('-', out);
+  fputs("+\n", out);
+  for (int y = 0; y < SIM_HEIGHT; y += 2)
+  {
+    fputc('|', out);
+    if (ansi) fputs("\033[34;47m", out);
+    for (int x = 0; x < SIM_WIDTH; x++)
+      fputs(blocks[sim_pixel(x, y) | sim_pixel(x, y + 1) << 1], out);
+    if (ansi) fputs("\033[0m", out);
+    fputs("|\n", out);
+  }
+  fputc('+', out);
+  for (int x = 0; x < SIM_WIDTH; x++) fputc('-', out);
+  fputs("+\n", out);
+}
+
+/** PNG, 8 bit gray in stored deflate blocks **/
+
+static uint32_t png_crc_table[256];
+
+static uint32_t png_crc(uint32_t crc, const uint8_t *buf, size_t len)
+{
+  if (!png_crc_table[1])
+    for (uint32_t n = 0; n < 256; n++)
+    {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      png_crc_table[n] = c;
+    }
+  crc ^= 0xFFFFFFFF;
+  while (len--) crc = png_crc_table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+  return crc ^ 0xFFFFFFFF;
+}
+
+static void png_put32(uint8_t *p, uint32_t v)
+{
+  p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static void png_chunk(FILE *f, const char *type, const uint8_t *data, size_t len)
+{
+  uint8_t head[8];
+  png_put32(head, len);
+  memcpy(head + 4, type, 4);
+  fwrite(head, 1, 8, f);
+  fwrite(data, 1, len, f);
+  uint32_t crc = png_crc(png_crc(0, head + 4, 4), data, len);
+  png_put32(head, crc);
+  fwrite(head, 1, 4, f);
+}
+
+bool sim_display_png(const char *path, int scale)
+{
+  if (sim_display != SIM_ST7565 && sim_display != SIM_ST7920) return false; // no character ROM for the HD44780
+  if (scale < 1) scale = 1;
+
+  const size_t w = SIM_WIDTH * scale, h = SIM_HEIGHT * scale;
+  const size_t raw_len = (w + 1) * h;
+  uint8_t *raw = (uint8_t *)malloc(raw_len);
+  const size_t blocks = (raw_len + 65534) / 65535;
+  uint8_t *z = (uint8_t *)malloc(raw_len + blocks * 5 + 6);
+  if (!raw || !z) { free(raw); free(z); return false; }
+
+  for (size_t y = 0; y < h; y++)
+  {
+    uint8_t *row = raw + y * (w + 1);
+    row[0] = 0; // no filter
+    for (size_t x = 0; x < w; x++)
+      row[1 + x] = sim_pixel(x / scale, y / scale) ? 0x20 : 0xD8;
+  }
+
+  size_t zlen = 0;
+  z[zlen++] = 0x78;
+  z[zlen++] = 0x01;
+  for (size_t pos = 0; pos < raw_len; pos += 65535)
+  {
+    size_t n = raw_len - pos < 65535 ? raw_len - pos : 65535;
+    z[zlen++] = pos + n == raw_len;
+    z[zlen++] = n; z[zlen++] = n >> 8;
+    z[zlen++] = ~n; z[zlen++] = ~n >> 8;
+    memcpy(z + zlen, raw + pos, n);
+    zlen += n;
+  }
+  uint32_t a = 1, b = 0;
+  for (size_t i = 0; i < raw_len; i++) { a = (a + raw[i]) % 65521; b = (b + a) % 65521; }
+  png_put32(z + zlen, b << 16 | a);
+  zlen += 4;
+
+  FILE *f = fopen(path, "wb");
+  if (f)
+  {
+    static const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t ihdr[13];
+    png_put32(ihdr, w);
+    png_put32(ihdr + 4, h);
+    ihdr[8] = 8;  // bit depth
+    ihdr[9] = 0;  // gray
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    fwrite(signature, 1, sizeof(signature), f);
+    png_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+    png_chunk(f, "IDAT", z, zlen);
+    png_chunk(f, "IEND", NULL, 0);
+    fclose(f);
+  }
+  free(raw);
+  free(z);
+  return f != NULL;
+}
@@ -0,0 +1,476 @@
+// Stand-ins for the firmware modules the LCD code uses: Marlin_main, the planner,
+// the stepper, the temperature control and the SD card reader. They hold the
+// printer state the menus show and edit, nothing moves or heats.
+// This is the only simulator file that sees the Marlin headers and configuration.
+
+#include "Marlin.h"
+#include "planner.h"
+#include "stepper.h"
+#include "temperature.h"
+#include "ultralcd.h"
+#include "cardreader.h"
+#include "ConfigurationStore.h"
+#include "language.h"
+
+#include "sim.h"
+
+#ifndef ULTRA_LCD
+  #error "The LCD simulator needs an LCD, choose one with DISPLAY= in the Makefile."
+#endif
+#ifndef LCD_RENDER_STATS
+  #error "The LCD simulator counts the frames with LCD_RENDER_STATS."
+#endif
+
+// The same defaults as ultralcd.cpp
+#if !defined(LCD_I2C_VIKI)
+  #ifndef ENCODER_STEPS_PER_MENU_ITEM
+    #define ENCODER_STEPS_PER_MENU_ITEM 5
+  #endif
+#else
+  #ifndef ENCODER_STEPS_PER_MENU_ITEM
+    #define ENCODER_STEPS_PER_MENU_ITEM 2
+  #endif
+#endif
+#ifndef ENCODER_PULSES_PER_STEP
+  #define ENCODER_PULSES_PER_STEP 1
+#endif
+
+/** Marlin_main **/
+
+float current_position[NUM_AXIS] = { 0.0, 0.0, 0.0, 0.0 };
+float add_homing[3] = { 0, 0, 0 };
+float min_pos[3] = { X_MIN_POS, Y_MIN_POS, Z_MIN_POS };
+float max_pos[3] = { X_MAX_POS, Y_MAX_POS, Z_MAX_POS };
+bool axis_known_position[3] = { false, false, false };
+float zprobe_zoffset;
+int feedmultiply = 100;
+int extrudemultiply = 100;
+int extruder_multiply[EXTRUDERS] = { 100
+  #if EXTRUDERS > 1
+    , 100
+    #if EXTRUDERS > 2
+      , 100
+    #endif
+  #endif
+};
+bool volumetric_enabled = false;
+float filament_size[EXTRUDERS];
+float volumetric_multiplier[EXTRUDERS];
+int fanSpeed = 0;
+uint8_t active_extruder = 0;
+unsigned long starttime = 0;
+unsigned long stoptime = 0;
+bool cancel_heatup = false;
+#ifdef ULTIPANEL
+  #ifdef PS_DEFAULT_OFF
+    bool powersupply = false;
+  #else
+    bool powersupply = true;
+  #endif
+#endif
+#ifdef FWRETRACT
+bool autoretract_enabled = false;
+bool retracted[EXTRUDERS];
+float retract_length = RETRACT_LENGTH;
+float retract_length_swap = RETRACT_LENGTH_SWAP;
+float retract_feedrate = RETRACT_FEEDRATE;
+float retract_zlift = RETRACT_ZLIFT;
+float retract_recover_length = RETRACT_RECOVER_LENGTH;
+float retract_recover_length_swap = RETRACT_RECOVER_LENGTH_SWAP;
+float retract_recover_feedrate = RETRACT_RECOVER_FEEDRATE;
+#endif
+
+const char errormagic[] PROGMEM = "Error:";
+const char echomagic[] PROGMEM = "echo:";
+
+void serial_echopair_P(const char *s_P, float v)         { serialprintPGM(s_P); SERIAL_ECHO(v); }
+void serial_echopair_P(const char *s_P, double v)        { serialprintPGM(s_P); SERIAL_ECHO(v); }
+void serial_echopair_P(const char *s_P, unsigned long v) { serialprintPGM(s_P); SERIAL_ECHO(v); }
+
+// The menus queue G-codes for Marlin_main, the simulator reports them
+void enquecommand(const char *cmd)
+{
+  sim_gcode(cmd);
+}
+
+void enquecommand_P(const char *cmd)
+{
+  sim_gcode(cmd);
+}
+
+void refresh_cmd_timeout(void) {}
+
+void calculate_volumetric_multipliers()
+{
+  for (uint8_t e = 0; e < EXTRUDERS; e++)
+    volumetric_multiplier[e] = (volumetric_enabled && filament_size[e] > 0) ? 1.0 / (M_PI * filament_size[e] * filament_size[e] / 4.0) : 1.0;
+}
+
+/** planner **/
+
+unsigned long minsegmenttime;
+float max_feedrate[NUM_AXIS];
+float axis_steps_per_unit[NUM_AXIS];
+unsigned long max_acceleration_units_per_sq_second[NUM_AXIS];
+float minimumfeedrate;
+float acceleration;
+float retract_acceleration;
+float max_xy_jerk;
+float max_z_jerk;
+float max_e_jerk;
+float mintravelfeedrate;
+#ifdef AUTOTEMP
+bool autotemp_enabled = false;
+float autotemp_min = 210;
+float autotemp_max = 250;
+float autotemp_factor = 0.1;
+#endif
+volatile unsigned char block_buffer_head = 0;
+volatile unsigned char block_buffer_tail = 0;
+
+// Moves complete at once, the menus see an empty planner
+void plan_buffer_line(const float &x, const float &y, const float &z, const float &e, float feed_rate, const uint8_t &extruder) {}
+void plan_set_position(const float &x, const float &y, const float &z, const float &e) {}
+uint8_t movesplanned() { return 0; }
+void reset_acceleration_rates() {}
+
+/** stepper **/
+
+void quickStop() {}
+
+/** temperature **/
+
+int target_temperature[EXTRUDERS] = { 0 };
+int target_temperature_bed = 0;
+float current_temperature[EXTRUDERS] = { 0.0 };
+float current_temperature_bed = 0.0;
+float Kp, Ki, Kd, Kc;
+
+float scalePID_i(float i)   { return i * PID_dT; }
+float unscalePID_i(float i) { return i / PID_dT; }
+float scalePID_d(float d)   { return d / PID_dT; }
+float unscalePID_d(float d) { return d * PID_dT; }
+void updatePID() {}
+void setWatch() {}
+
+/** SD card **/
+
+// A flat directory tree of names added by the script, directories end with '/'
+#define SIM_CARD_FILES 32
+static char sim_card_files[SIM_CARD_FILES][LONG_FILENAME_LENGTH];
+static uint8_t sim_card_count = 0;
+static char sim_card_dir[LONG_FILENAME_LENGTH] = ""; // "" is the root, else "dir/"
+
+CardReader card;
+
+CardReader::CardReader()
+{
+  filesize = 0;
+  sdpos = 0;
+  sdprinting = false;
+  cardOK = false;
+  saving = false;
+  logging = false;
+  autostart_atmillis = 0;
+  workDirDepth = 0;
+  file_subcall_ctr = 0;
+  autostart_stilltocheck = true;
+  lastnr = 0;
+  filenameIsDir = false;
+}
+
+void CardReader::initsd() { cardOK = true; }
+void CardReader::release() { sdprinting = false; cardOK = false; }
+void CardReader::checkautostart(bool force) {}
+void CardReader::closefile(bool store_location) {}
+void CardReader::startFileprint() { if (cardOK) sdprinting = true; }
+void CardReader::pauseSDPrint() { sdprinting = false; }
+
+// Name of the nr-th entry in the working directory, directories once for all their files
+static const char *sim_card_entry(uint16_t nr, bool &is_dir, uint8_t &len)
+{
+  size_t dir_len = strlen(sim_card_dir);
+  uint16_t n = 0;
+  for (uint8_t i = 0; i < sim_card_count; i++)
+  {
+    const char *name = sim_card_files[i];
+    if (strncmp(name, sim_card_dir, dir_len) != 0) continue;
+    name += dir_len;
+    const char *slash = strchr(name, '/');
+    len = slash ? slash - name : strlen(name);
+    if (len == 0) continue;
+    bool listed = false;
+    for (uint8_t j = 0; j < i && slash; j++)
+      if (strncmp(sim_card_files[j], sim_card_files[i], dir_len + len + 1) == 0) listed = true;
+    if (listed) continue;
+    if (n++ == nr)
+    {
+      is_dir = slash != NULL;
+      return name;
+    }
+  }
+  return NULL;
+}
+
+uint16_t CardReader::getnrfilenames()
+{
+  bool is_dir;
+  uint8_t len;
+  uint16_t n = 0;
+  while (sim_card_entry(n, is_dir, len)) n++;
+  return n;
+}
+
+// The 8.3 name of an entry, upper case, long names shortened like "LONGNA~1.GCO"
+static void sim_card_short_name(const char *name, uint8_t len, bool is_dir, char *out)
+{
+  const char *dot = NULL;
+  if (!is_dir)
+    for (const char *c = name; c < name + len; c++)
+      if (*c == '.') dot = c;
+  uint8_t base = dot ? dot - name : len;
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < base && n < 8; i++) out[n++] = toupper(name[i]);
+  if (base > 8) { out[6] = '~'; out[7] = '1'; }
+  for (const char *c = dot; c && c < name + len && c < dot + 4; c++) out[n++] = toupper(*c);
+  out[n] = '\0';
+}
+
+void CardReader::getfilename(uint16_t nr, const char * const match)
+{
+  bool is_dir = false;
+  uint8_t len = 0;
+  const char *name = sim_card_entry(nr, is_dir, len);
+  if (!name) len = 0;
+  len = min(len, LONG_FILENAME_LENGTH - 1);
+  memcpy(longFilename, name, len);
+  longFilename[len] = '\0';
+  sim_card_short_name(longFilename, len, is_dir, filename);
+  filenameIsDir = is_dir;
+}
+
+void CardReader::chdir(const char *relpath)
+{
+  bool is_dir;
+  uint8_t len;
+  const char *name;
+  char short_name[13];
+  for (uint16_t nr = 0; (name = sim_card_entry(nr, is_dir, len)) != NULL; nr++)
+  {
+    if (!is_dir) continue;
+    sim_card_short_name(name, len, true, short_name);
+    if (strcmp(short_name, relpath) != 0) continue;
+    if (strlen(sim_card_dir) + len + 1 < sizeof(sim_card_dir))
+    {
+      strncat(sim_card_dir, name, len + 1);
+      workDirDepth++;
+    }
+    return;
+  }
+}
+
+void CardReader::updir()
+{
+  size_t len = strlen(sim_card_dir);
+  if (len == 0) return;
+  sim_card_dir[len - 1] = '\0';
+  char *slash = strrchr(sim_card_dir, '/');
+  if (slash) slash[1] = '\0'; else sim_card_dir[0] = '\0';
+  if (workDirDepth > 0) workDirDepth--;
+}
+
+void CardReader::setroot()
+{
+  sim_card_dir[0] = '\0';
+  workDirDepth = 0;
+}
+
+// No file is ever opened, CardReader only closes them
+bool SdBaseFile::close() { return true; }
+size_t SdFile::write(uint8_t b) { return 0; }
+
+// Only used on the working directory, the menu shows ".." unless it is "/"
+bool SdBaseFile::getFilename(char *name)
+{
+  size_t len = strlen(sim_card_dir);
+  if (len == 0)
+  {
+    strcpy(name, "/");
+    return true;
+  }
+  const char *last = sim_card_dir + len - 1;
+  while (last > sim_card_dir && last[-1] != '/') last--;
+  sim_card_short_name(last, sim_card_dir + len - 1 - last, true, name);
+  return true;
+}
+
+void sim_card_add(const char *path)
+{
+  if (sim_card_count < SIM_CARD_FILES)
+  {
+    strncpy(sim_card_files[sim_card_count], path, LONG_FILENAME_LENGTH - 1);
+    sim_card_files[sim_card_count++][LONG_FILENAME_LENGTH - 1] = '\0';
+  }
+}
+
+/** pins the simulator drives and watches **/
+
+#define SIM_INPUT(IO) _SIM_INPUT(IO)
+#define _SIM_INPUT(IO) sim_input_t(&DIO ## IO ## _RPORT, MASK(DIO ## IO ## _PIN))
+#define SIM_OUTPUT(IO) _SIM_OUTPUT(IO)
+#define _SIM_OUTPUT(IO) sim_output_t(__builtin_addressof(DIO ## IO ## _WPORT), MASK(DIO ## IO ## _PIN))
+
+static sim_input_t sim_pin_en1, sim_pin_en2, sim_pin_enc, sim_pin_card;
+
+static void sim_pin_write(const sim_input_t &pin, bool level)
+{
+  if (!pin.reg) return;
+  if (level) *pin.reg |= pin.mask; else *pin.reg &= ~pin.mask;
+}
+
+/** the simulator's view of the firmware **/
+
+static unsigned long sim_frames_seen = 0;
+static unsigned long sim_draws_seen = 0;
+
+void sim_firmware_init()
+{
+  #ifdef NEWPANEL
+    sim_pin_en1 = SIM_INPUT(BTN_EN1);
+    sim_pin_en2 = SIM_INPUT(BTN_EN2);
+    #if BTN_ENC > 0
+      sim_pin_enc = SIM_INPUT(BTN_ENC);
+    #endif
+  #endif
+  #if defined(SDSUPPORT) && defined(SDCARDDETECT) && SDCARDDETECT > 0
+    sim_pin_card = SIM_INPUT(SDCARDDETECT);
+  #endif
+  // The buttons are active low with pull-ups, the card is out
+  sim_pin_write(sim_pin_en1, true);
+  sim_pin_write(sim_pin_en2, true);
+  sim_pin_write(sim_pin_enc, true);
+  sim_pin_write(sim_pin_card, true);
+
+  #if defined(U8GLIB_ST7920)
+    sim_st7920_attach(SIM_OUTPUT(LCD_PINS_RS), SIM_OUTPUT(LCD_PINS_D4), SIM_OUTPUT(LCD_PINS_ENABLE));
+  #elif defined(DOGLCD)
+    // The boards that turn the picture by 180 degrees have the glass mounted that way
+    #ifdef LCD_SCREEN_ROT_180
+      const bool upside_down = true;
+    #else
+      const bool upside_down = false;
+    #endif
+    #ifdef MAKRPANEL
+      sim_st7565_attach(4, upside_down); // the NHD C12864 glass starts at column 4
+    #else
+      sim_st7565_attach(0, upside_down);
+    #endif
+  #endif
+
+  // Marlin's setup()
+  MYSERIAL.begin(BAUDRATE);
+  Config_RetrieveSettings();
+  lcd_init();
+  _delay_ms(1000); // the splash screen
+  lcd_render_stats_reset();
+}
+
+void sim_firmware_interrupt()
+{
+  static bool odd = false;
+  if ((odd = !odd)) lcd_buttons_update(); // every other tick of TIMER0_COMPB, about 2 ms
+}
+
+void sim_firmware_tick()
+{
+  lcd_update();
+
+  if (lcd_render_stats.frames != sim_frames_seen)
+  {
+    sim_frame_done(lcd_render_stats.frames, lcd_render_stats.draws - sim_draws_seen);
+    sim_frames_seen = lcd_render_stats.frames;
+    sim_draws_seen = lcd_render_stats.draws;
+  }
+}
+
+bool sim_firmware_encoder(int8_t steps)
+{
+  #ifdef NEWPANEL
+    // Gray code as lcd_buttons_update() counts it up (encrot0..3), each state change is one pulse
+    static const uint8_t gray[4] = { 0, 2, 3, 1 };
+    static uint8_t phase = 0;
+    long pulses = (long)steps * ENCODER_PULSES_PER_STEP;
+    while (pulses != 0)
+    {
+      phase = (phase + (pulses > 0 ? 1 : 3)) & 3;
+      pulses += pulses > 0 ? -1 : 1;
+      sim_pin_write(sim_pin_en1, !(gray[phase] & 1)); // a closed contact reads low
+      sim_pin_write(sim_pin_en2, !(gray[phase] & 2));
+      lcd_buttons_update();
+    }
+    return true;
+  #else
+    return false;
+  #endif
+}
+
+int sim_firmware_steps_per_item()
+{
+  return ENCODER_STEPS_PER_MENU_ITEM;
+}
+
+bool sim_firmware_button(bool pressed)
+{
+  if (!sim_pin_enc.reg) return false;
+  sim_pin_write(sim_pin_enc, !pressed);
+  return true;
+}
+
+bool sim_firmware_card(bool inserted)
+{
+  #if defined(SDSUPPORT) && defined(SDCARDDETECT) && SDCARDDETECT > 0
+    #ifdef SDCARDDETECTINVERTED
+      sim_pin_write(sim_pin_card, inserted);
+    #else
+      sim_pin_write(sim_pin_card, !inserted);
+    #endif
+    return true;
+  #elif defined(SDSUPPORT)
+    // No detect line, the card counts as inserted and is read with the menu
+    if (inserted) card.initsd(); else card.release();
+    return true;
+  #else
+    return false;
+  #endif
+}
+
+void sim_firmware_status(const char *message)
+{
+  lcd_setstatus(message);
+}
+
+bool sim_firmware_temperature(int heater, float current, int target)
+{
+  if (heater < 0)
+  {
+    current_temperature_bed = current;
+    if (target >= 0) target_temperature_bed = target;
+    return true;
+  }
+  if (heater >= EXTRUDERS) return false;
+  current_temperature[heater] = current;
+  if (target >= 0) target_temperature[heater] = target;
+  return true;
+}
+
+void sim_firmware_position(float x, float y, float z)
+{
+  current_position[X_AXIS] = x;
+  current_position[Y_AXIS] = y;
+  current_position[Z_AXIS] = z;
+}
+
+void sim_firmware_printing(bool on)
+{
+  starttime = on ? millis() : 0;
+}
@@ -0,0 +1,27 @@
+// Host stand-in for the Arduino LiquidCrystal library. The simulator keeps the
+// HD44780 character and CGRAM contents and counts the bytes sent to them.
+#ifndef SIM_LIQUIDCRYSTAL_H
+#define SIM_LIQUIDCRYSTAL_H
+
+#include <stdint.h>
+#include "Print.h"
+
+class LiquidCrystal : public Print
+{
+  public:
+    LiquidCrystal(uint8_t rs, uint8_t enable, uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3) {}
+    LiquidCrystal(uint8_t rs, uint8_t rw, uint8_t enable, uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3) {}
+
+    void begin(uint8_t cols, uint8_t rows);
+    void clear();
+    void home();
+    void noDisplay() { command(0x08); }
+    void display() { command(0x0C); }
+    void setCursor(uint8_t col, uint8_t row);
+    void createChar(uint8_t location, uint8_t charmap[]);
+    void command(uint8_t value);
+    virtual size_t write(uint8_t value);
+    using Print::write;
+};
+
+#endif // SIM_LIQUIDCRYSTAL_H
@@ -0,0 +1,20 @@
+// Host stand-in for the Arduino String class, as far as MarlinSerial uses it.
+#ifndef SIM_WSTRING_H
+#define SIM_WSTRING_H
+
+#include <string.h>
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+class String
+{
+  public:
+    String(const char *s = "") : str(s) {}
+    unsigned int length() const { return strlen(str); }
+    char operator[](unsigned int i) const { return str[i]; }
+  private:
+    const char *str;
+};
+
+#endif // SIM_WSTRING_H
@@ -0,0 +1,12 @@
+// Host stand-in for <avr/interrupt.h>. Nothing runs concurrently in the simulator.
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define cli()
+#define sei()
+#define ISR(vector) extern "C" void vector(void)
+#define SIGNAL(vector) ISR(vector)
+
+#endif // SIM_AVR_INTERRUPT_H
@@ -0,0 +1,254 @@
+// Host stand-in for <avr/io.h>, enough for fastio.h and MarlinSerial.h.
+// The input registers (PINx) are plain variables the simulator sets. The output
+// registers (PORTx) report their changes, the ST7920 is driven through them.
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define _BV(bit) (1 << (bit))
+#define _SFR_BYTE(sfr) (sfr)
+
+struct sim_port_t
+{
+  uint8_t value;
+
+  sim_port_t &operator=(uint8_t v) { set(v); return *this; }
+  sim_port_t &operator|=(uint8_t mask) { set(value | mask); return *this; }
+  sim_port_t &operator&=(uint8_t mask) { set(value & mask); return *this; }
+  sim_port_t &operator^=(uint8_t mask) { set(value ^ mask); return *this; }
+  operator uint8_t() const { return value; }
+  volatile uint8_t *operator&() { return &value; } // pin tables, writes through them are not reported
+
+  void set(uint8_t v);
+};
+
+extern sim_port_t PORTA;
+extern volatile uint8_t PINA, DDRA;
+extern sim_port_t PORTB;
+extern volatile uint8_t PINB, DDRB;
+extern sim_port_t PORTC;
+extern volatile uint8_t PINC, DDRC;
+extern sim_port_t PORTD;
+extern volatile uint8_t PIND, DDRD;
+extern sim_port_t PORTE;
+extern volatile uint8_t PINE, DDRE;
+extern sim_port_t PORTF;
+extern volatile uint8_t PINF, DDRF;
+extern sim_port_t PORTG;
+extern volatile uint8_t PING, DDRG;
+extern sim_port_t PORTH;
+extern volatile uint8_t PINH, DDRH;
+extern sim_port_t PORTJ;
+extern volatile uint8_t PINJ, DDRJ;
+extern sim_port_t PORTK;
+extern volatile uint8_t PINK, DDRK;
+extern sim_port_t PORTL;
+extern volatile uint8_t PINL, DDRL;
+
+#define PINA0 0
+#define PINA1 1
+#define PINA2 2
+#define PINA3 3
+#define PINA4 4
+#define PINA5 5
+#define PINA6 6
+#define PINA7 7
+#define PA0 0
+#define PA1 1
+#define PA2 2
+#define PA3 3
+#define PA4 4
+#define PA5 5
+#define PA6 6
+#define PA7 7
+#define PINB0 0
+#define PINB1 1
+#define PINB2 2
+#define PINB3 3
+#define PINB4 4
+#define PINB5 5
+#define PINB6 6
+#define PINB7 7
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PINC0 0
+#define PINC1 1
+#define PINC2 2
+#define PINC3 3
+#define PINC4 4
+#define PINC5 5
+#define PINC6 6
+#define PINC7 7
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+#define PC7 7
+#define PIND0 0
+#define PIND1 1
+#define PIND2 2
+#define PIND3 3
+#define PIND4 4
+#define PIND5 5
+#define PIND6 6
+#define PIND7 7
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+#define PINE0 0
+#define PINE1 1
+#define PINE2 2
+#define PINE3 3
+#define PINE4 4
+#define PINE5 5
+#define PINE6 6
+#define PINE7 7
+#define PE0 0
+#define PE1 1
+#define PE2 2
+#define PE3 3
+#define PE4 4
+#define PE5 5
+#define PE6 6
+#define PE7 7
+#define PINF0 0
+#define PINF1 1
+#define PINF2 2
+#define PINF3 3
+#define PINF4 4
+#define PINF5 5
+#define PINF6 6
+#define PINF7 7
+#define PF0 0
+#define PF1 1
+#define PF2 2
+#define PF3 3
+#define PF4 4
+#define PF5 5
+#define PF6 6
+#define PF7 7
+#define PING0 0
+#define PING1 1
+#define PING2 2
+#define PING3 3
+#define PING4 4
+#define PING5 5
+#define PING6 6
+#define PING7 7
+#define PG0 0
+#define PG1 1
+#define PG2 2
+#define PG3 3
+#define PG4 4
+#define PG5 5
+#define PG6 6
+#define PG7 7
+#define PINH0 0
+#define PINH1 1
+#define PINH2 2
+#define PINH3 3
+#define PINH4 4
+#define PINH5 5
+#define PINH6 6
+#define PINH7 7
+#define PH0 0
+#define PH1 1
+#define PH2 2
+#define PH3 3
+#define PH4 4
+#define PH5 5
+#define PH6 6
+#define PH7 7
+#define PINJ0 0
+#define PINJ1 1
+#define PINJ2 2
+#define PINJ3 3
+#define PINJ4 4
+#define PINJ5 5
+#define PINJ6 6
+#define PINJ7 7
+#define PJ0 0
+#define PJ1 1
+#define PJ2 2
+#define PJ3 3
+#define PJ4 4
+#define PJ5 5
+#define PJ6 6
+#define PJ7 7
+#define PINK0 0
+#define PINK1 1
+#define PINK2 2
+#define PINK3 3
+#define PINK4 4
+#define PINK5 5
+#define PINK6 6
+#define PINK7 7
+#define PK0 0
+#define PK1 1
+#define PK2 2
+#define PK3 3
+#define PK4 4
+#define PK5 5
+#define PK6 6
+#define PK7 7
+#define PINL0 0
+#define PINL1 1
+#define PINL2 2
+#define PINL3 3
+#define PINL4 4
+#define PINL5 5
+#define PINL6 6
+#define PINL7 7
+#define PL0 0
+#define PL1 1
+#define PL2 2
+#define PL3 3
+#define PL4 4
+#define PL5 5
+#define PL6 6
+#define PL7 7
+
+extern volatile uint8_t SREG;
+
+// USART 0 for MarlinSerial, what is written to the data register goes to stderr
+struct sim_udr_t
+{
+  sim_udr_t &operator=(uint8_t c);
+  operator uint8_t() const { return 0; }
+};
+extern sim_udr_t UDR0;
+// The transmitter is always ready and nothing is ever received
+struct sim_ucsra_t
+{
+  uint8_t value;
+  sim_ucsra_t &operator=(uint8_t v) { value = v; return *this; }
+  operator uint8_t() const { return (value | _BV(5)) & ~_BV(7); } // UDRE0 set, RXC0 clear
+};
+extern sim_ucsra_t UCSR0A;
+extern volatile uint8_t UCSR0B, UBRR0H, UBRR0L;
+#define UDR0 UDR0     // MarlinSerial.h tests for the registers with defined()
+#define UBRR0H UBRR0H
+#define RXC0 7
+#define UDRE0 5
+#define U2X0 1
+#define RXEN0 4
+#define TXEN0 3
+#define RXCIE0 7
+
+#endif // SIM_AVR_IO_H
@@ -0,0 +1,10 @@
+// Host stand-in for <util/delay.h>. Busy waits advance the simulated clock.
+#ifndef SIM_UTIL_DELAY_H
+#define SIM_UTIL_DELAY_H
+
+void sim_advance_us(unsigned long us);
+
+#define _delay_ms(ms) sim_advance_us((unsigned long)((ms) * 1000))
+#define _delay_us(us) sim_advance_us((unsigned long)(us))
+
+#endif // SIM_UTIL_DELAY_H
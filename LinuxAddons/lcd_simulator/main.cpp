@@ -0,0 +1,165 @@
+// Runs a script of encoder, button and printer events against the LCD menus
+// and prints what the display shows, see Readme.md for the commands.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Arduino.h>
+
+#include "sim.h"
+
+static bool ansi = false;
+static bool quiet = false;
+
+// The last frame that changed the picture and the totals since the script started
+static unsigned long last_frame = 0, last_draws = 0, last_bytes = 0, last_time = 0;
+static unsigned long frames = 0, total_draws = 0, total_bytes = 0, max_bytes = 0;
+static unsigned long bytes_seen = 0;
+
+void sim_frame_done(unsigned long frame, unsigned long draws)
+{
+  unsigned long bytes = sim_display_bytes() - bytes_seen;
+  bytes_seen += bytes;
+  frames = frame;
+  total_draws += draws;
+  total_bytes += bytes;
+  if (bytes > max_bytes) max_bytes = bytes;
+  if (bytes == 0) return; // nothing new was sent, the picture is the one of the last frame
+  last_frame = frame;
+  last_draws = draws;
+  last_bytes = bytes;
+  last_time = millis();
+}
+
+void sim_gcode(const char *cmd)
+{
+  printf("queued: %s\n", cmd);
+}
+
+static void run_ms(unsigned long ms)
+{
+  while (ms--)
+  {
+    sim_firmware_tick();
+    sim_advance_us(1000);
+  }
+}
+
+static void show()
+{
+  if (ansi) fputs("\033[H\033[2J", stdout);
+  printf("frame %lu at %lu ms: %lu draws, %lu bytes\n", last_frame, last_time, last_draws, last_bytes);
+  sim_display_print(stdout, ansi);
+  fflush(stdout);
+}
+
+static bool unsupported(const char *what, bool ok)
+{
+  if (!ok) fprintf(stderr, "lcd_simulator: %s is not available with this display\n", what);
+  return ok;
+}
+
+static bool run_line(char *line, unsigned int line_nr)
+{
+  char *cmd = strtok(line, " \t\r\n");
+  if (!cmd || cmd[0] == '#') return true;
+  char *arg = strtok(NULL, "\r\n");
+  while (arg && (*arg == ' ' || *arg == '\t')) arg++;
+
+  if (!strcmp(cmd, "turn") && arg)
+    unsupported("the encoder", sim_firmware_encoder(atoi(arg)));
+  else if (!strcmp(cmd, "scroll") && arg)
+    unsupported("the encoder", sim_firmware_encoder(atoi(arg) * sim_firmware_steps_per_item()));
+  else if (!strcmp(cmd, "click"))
+  {
+    if (unsupported("the encoder button", sim_firmware_button(true)))
+    {
+      run_ms(150);
+      sim_firmware_button(false);
+    }
+  }
+  else if (!strcmp(cmd, "press"))
+    unsupported("the encoder button", sim_firmware_button(true));
+  else if (!strcmp(cmd, "release"))
+    unsupported("the encoder button", sim_firmware_button(false));
+  else if (!strcmp(cmd, "wait") && arg)
+    run_ms(atol(arg));
+  else if (!strcmp(cmd, "temp") && arg)
+  {
+    char heater[8];
+    float current;
+    int target = -1;
+    if (sscanf(arg, "%7s %f %d", heater, &current, &target) < 2) goto bad;
+    int nr = heater[0] == 'B' || heater[0] == 'b' ? -1 : atoi(heater[0] == 'E' || heater[0] == 'e' ? heater + 1 : heater);
+    unsupported("that heater", sim_firmware_temperature(nr, current, target));
+  }
+  else if (!strcmp(cmd, "status"))
+    sim_firmware_status(arg ? arg : "");
+  else if (!strcmp(cmd, "card") && arg)
+    unsupported("the SD card", sim_firmware_card(!strcmp(arg, "insert")));
+  else if (!strcmp(cmd, "file") && arg)
+    sim_card_add(arg);
+  else if (!strcmp(cmd, "pos") && arg)
+  {
+    float x, y, z;
+    if (sscanf(arg, "%f %f %f", &x, &y, &z) != 3) goto bad;
+    sim_firmware_position(x, y, z);
+  }
+  else if (!strcmp(cmd, "print") && arg)
+    sim_firmware_printing(!strcmp(arg, "on"));
+  else if (!strcmp(cmd, "show"))
+  {
+    if (!quiet) show();
+  }
+  else if (!strcmp(cmd, "png") && arg)
+  {
+    if (!sim_display_png(arg, 4))
+    {
+      fprintf(stderr, "lcd_simulator: line %u: can not write %s\n", line_nr, arg);
+      return false;
+    }
+  }
+  else if (!strcmp(cmd, "stats"))
+  {
+    printf("%lu frames, %lu draws, %lu bytes, %lu bytes in the largest frame\n",
+      frames, total_draws, total_bytes, max_bytes);
+  }
+  else
+    goto bad;
+  return true;
+
+bad:
+  fprintf(stderr, "lcd_simulator: line %u: can not run '%s%s%s'\n", line_nr, cmd, arg ? " " : "", arg ? arg : "");
+  return false;
+}
+
+int main(int argc, char **argv)
+{
+  FILE *script = stdin;
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--ansi")) ansi = true;
+    else if (!strcmp(argv[i], "-q")) quiet = true;
+    else if (argv[i][0] != '-' && script == stdin)
+    {
+      script = fopen(argv[i], "r");
+      if (!script) { perror(argv[i]); return 2; }
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [--ansi] [-q] [script]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  sim_firmware_init();
+  bytes_seen = sim_display_bytes();
+
+  char line[256];
+  unsigned int line_nr = 0;
+  int errors = 0;
+  while (fgets(line, sizeof(line), script))
+    if (!run_line(line, ++line_nr)) errors++;
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+// Interface between the parts of the LCD simulator. Only firmware.cpp sees the
+// Marlin headers, the clock, the displays and the script runner use this.
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <avr/io.h>
+
+// A pin the simulator drives, one bit of a PINx register
+struct sim_input_t
+{
+  volatile uint8_t *reg;
+  uint8_t mask;
+  sim_input_t() : reg(NULL), mask(0) {}
+  sim_input_t(volatile uint8_t *r, uint8_t m) : reg(r), mask(m) {}
+};
+
+// A pin the simulator watches, one bit of a PORTx register
+struct sim_output_t
+{
+  sim_port_t *port;
+  uint8_t mask;
+  sim_output_t() : port(NULL), mask(0) {}
+  sim_output_t(sim_port_t *p, uint8_t m) : port(p), mask(m) {}
+};
+
+/** clock (arduino.cpp) **/
+
+void sim_advance_us(unsigned long us);
+
+/** firmware (firmware.cpp) **/
+
+void sim_firmware_init();                  // Marlin's setup() as far as the LCD goes
+void sim_firmware_interrupt();             // the temperature interrupt, every millisecond
+void sim_firmware_tick();                  // one pass of the main loop
+bool sim_firmware_encoder(int8_t steps);   // turn the encoder, positive is clockwise
+int sim_firmware_steps_per_item();
+bool sim_firmware_button(bool pressed);
+bool sim_firmware_card(bool inserted);
+void sim_firmware_status(const char *message);
+bool sim_firmware_temperature(int heater, float current, int target); // heater -1 is the bed
+void sim_firmware_position(float x, float y, float z);
+void sim_firmware_printing(bool on);
+void sim_card_add(const char *path);
+
+// Reported by the firmware side to the script runner (main.cpp)
+void sim_gcode(const char *cmd);
+void sim_frame_done(unsigned long frame, unsigned long draws);
+
+/** displays (display.cpp) **/
+
+void sim_st7565_attach(uint8_t first_column, bool upside_down);
+void sim_st7920_attach(sim_output_t cs, sim_output_t clk, sim_output_t dat);
+void sim_display_port_changed(sim_port_t *port, uint8_t old_value);
+
+unsigned long sim_display_bytes();         // bytes sent to the display controller so far
+void sim_display_print(FILE *out, bool ansi);
+bool sim_display_png(const char *path, int scale);
+
+#endif // SIM_H
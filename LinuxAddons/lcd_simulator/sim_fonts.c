@@ -0,0 +1,7 @@
+/* u8glib ships u8g_font_5x8 and u8g_font_9x18 in its font collection, which is
+   not part of this tree. The Marlin fonts of about the same size stand in for
+   them, the pictures differ from the printer where the menus use those two. */
+
+#define u8g_font_6x9 u8g_font_5x8
+#define u8g_font_6x10_marlin u8g_font_9x18
+#include "../../Marlin/dogm_font_data_marlin.h"
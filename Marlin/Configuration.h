@@ -375,7 +375,6 @@ const bool Z_MAX_ENDSTOP_INVERTING = true; // set to true to invert the logic of
   // with AUTO_BED_LEVELING_GRID, the bed is sampled in a
   // AUTO_BED_LEVELING_GRID_POINTSxAUTO_BED_LEVELING_GRID_POINTS grid
   // and least squares solution is calculated
-  // Note: this feature occupies 10'206 byte
   #ifdef AUTO_BED_LEVELING_GRID
 
     // set the rectangle in which to probe
@@ -388,6 +387,14 @@ const bool Z_MAX_ENDSTOP_INVERTING = true; // set to true to invert the logic of
      // I wouldn't see a reason to go above 3 (=9 probing points on the bed)
     #define AUTO_BED_LEVELING_GRID_POINTS 2
 
+    // With AUTO_BED_LEVELING_MESH the probed heights are kept as a mesh instead of
+    // being fitted to a plane. The Z correction is bilinearly interpolated between
+    // the grid points and moves are split where they cross a grid line, so warped
+    // beds are followed too. Use 3 or more grid points to get any benefit over a plane.
+    // The mesh is stored with M500 and is applied after the next G28. M501 keeps an
+    // applied mesh applied with the reloaded values, M502 drops it.
+    //#define AUTO_BED_LEVELING_MESH
+
 
   #else  // not AUTO_BED_LEVELING_GRID
     // with no grid, just probe 3 arbitrary points.  A simple cross-product
@@ -415,7 +422,14 @@ const bool Z_MAX_ENDSTOP_INVERTING = true; // set to true to invert the logic of
   #define XY_TRAVEL_SPEED 8000         // X and Y axis travel speed between probes, in mm/min
 
   #define Z_RAISE_BEFORE_PROBING 15    //How much the extruder will be raised before traveling to the first probing point.
-  #define Z_RAISE_BETWEEN_PROBINGS 5  //How much the extruder will be raised when traveling from between next probing points
+  #define Z_RAISE_BETWEEN_PROBINGS 5  //How much the extruder will be raised above the last probed point when traveling to the next one.
+                                      //It only has to clear the bed variation between neighbouring points, the fast approach covers the rest.
+
+  // Each point is probed in two stages: a fast approach until the probe triggers,
+  // then a short retract and a slow re-touch which gives the measured height.
+  #define Z_PROBE_FEEDRATE_FAST (4*60)                    // (mm/min) approach speed
+  #define Z_PROBE_FEEDRATE_SLOW (Z_PROBE_FEEDRATE_FAST/4) // (mm/min) re-touch speed
+  #define Z_PROBE_BUMP 2                                  // (mm) retract between the two stages
 
   //#define Z_PROBE_SLED // turn on if you have a z-probe mounted on a sled like those designed by Charles Bell
   //#define SLED_DOCKING_OFFSET 5 // the extra distance the X axis must travel to pickup the sled. 0 should be fine but you can push it further if you'd like.
@@ -783,7 +797,8 @@ const bool Z_MAX_ENDSTOP_INVERTING = true; // set to true to invert the logic of
 #define DEFAULT_NOMINAL_FILAMENT_DIA  3.0  //Enter the diameter (in mm) of the filament generally used (3.0 mm or 1.75 mm) - this is then used in the slicer software.  Used for sensor reading validation
 #define MEASURED_UPPER_LIMIT          3.30  //upper limit factor used for sensor reading validation in mm
 #define MEASURED_LOWER_LIMIT          1.90  //lower limit factor for sensor reading validation in mm
-#define MAX_MEASUREMENT_DELAY			20  //delay buffer size in bytes (1 byte = 1cm)- limits maximum measurement delay allowable (must be larger than MEASUREMENT_DELAY_CM  and lower number saves RAM)
+#define MAX_MEASUREMENT_DELAY			20  //maximum measurement delay in cm (must be larger than MEASUREMENT_DELAY_CM, a lower number saves RAM)
+#define FILWIDTH_SAMPLE_MM    5   //filament distance between two stored readings in mm, the readings in between are interpolated (a larger number saves RAM)
 
 //defines used in the code
 #define DEFAULT_MEASURED_FILAMENT_DIA  DEFAULT_NOMINAL_FILAMENT_DIA  //set measured to nominal initially 
@@ -3,124 +3,263 @@
 #include "temperature.h"
 #include "ultralcd.h"
 #include "ConfigurationStore.h"
+#include "language.h"
 
-void _EEPROM_writeData(int &pos, uint8_t* value, uint8_t size)
+#ifdef EEPROM_SETTINGS
+#include <util/crc16.h>
+
+/*
+ * The settings are kept in EEPROM_SLOTS slots behind EEPROM_OFFSET. Each M500 writes the slot after
+ * the newest one, so the writes are spread over the slots. A slot holds a header and a list of
+ * fields, each with an id and its size:
+ *
+ *   format, sequence (2 bytes), length of the fields (2 bytes), CRC16 of the fields (2 bytes)
+ *   id, size, data, id, size, data, ...
+ *
+ * Loading takes the valid slot with the highest sequence number. Fields are found by their id, so
+ * settings added later or compiled out don't shift the others. A field that is missing or changed
+ * its size keeps the default value. Bytes are only written when they differ from the EEPROM.
+ */
+#define EEPROM_OFFSET 100
+#define EEPROM_FORMAT 0x51 // changes only with the slot layout, not with the fields
+#define EEPROM_HEADER_SIZE 7
+#define EEPROM_SLOT_SIZE ((E2END + 1 - EEPROM_OFFSET) / EEPROM_SLOTS)
+
+static void Config_LoadDefaults();
+
+// Field ids. Never reuse or renumber an id, add new settings at the end.
+enum {
+  EE_STEPS_PER_UNIT = 1, EE_MAX_FEEDRATE, EE_MAX_ACCELERATION, EE_ACCELERATION, EE_RETRACT_ACCELERATION,
+  EE_MINIMUMFEEDRATE, EE_MINTRAVELFEEDRATE, EE_MINSEGMENTTIME, EE_MAX_XY_JERK, EE_MAX_Z_JERK, EE_MAX_E_JERK,
+  EE_ADD_HOMING, EE_ENDSTOP_ADJ, EE_DELTA_RADIUS, EE_DELTA_DIAGONAL_ROD, EE_DELTA_SEGMENTS_PER_SECOND,
+  EE_PLA_HOTEND_TEMP, EE_PLA_HPB_TEMP, EE_PLA_FAN_SPEED, EE_ABS_HOTEND_TEMP, EE_ABS_HPB_TEMP, EE_ABS_FAN_SPEED,
+  EE_ZPROBE_ZOFFSET, EE_KP, EE_KI, EE_KD, EE_BED_KP, EE_BED_KI, EE_BED_KD, EE_LCD_CONTRAST, EE_AXIS_SCALING,
+  EE_AUTORETRACT_ENABLED, EE_RETRACT_LENGTH, EE_RETRACT_LENGTH_SWAP, EE_RETRACT_FEEDRATE, EE_RETRACT_ZLIFT,
+  EE_RETRACT_RECOVER_LENGTH, EE_RETRACT_RECOVER_LENGTH_SWAP, EE_RETRACT_RECOVER_FEEDRATE,
+  EE_VOLUMETRIC_ENABLED, EE_FILAMENT_SIZE, EE_FILAMENT_SIZE_1, EE_FILAMENT_SIZE_2,
+  EE_MAX_VOLUMETRIC_FLOW, EE_MAX_VOLUMETRIC_FLOW_1, EE_MAX_VOLUMETRIC_FLOW_2,
+  EE_MESH_VALID, EE_KC,
+  EE_MESH_ROW = 128 // one id per mesh row, up to 191
+};
+
+static int eeprom_pos;          // next byte of the slot being written or compared
+static int eeprom_end;          // end of the slot
+static uint16_t eeprom_crc;
+static bool eeprom_compare;     // only check whether the slot already holds these bytes
+static bool eeprom_differs;
+
+static void _EEPROM_putByte(uint8_t value)
 {
-    do
+    eeprom_crc = _crc16_update(eeprom_crc, value);
+    if (eeprom_pos < eeprom_end)
     {
-        eeprom_write_byte((unsigned char*)pos, *value);
-        pos++;
-        value++;
-    }while(--size);
+        uint8_t stored = eeprom_read_byte((unsigned char*)eeprom_pos);
+        if (stored != value)
+        {
+            if (eeprom_compare)
+                eeprom_differs = true;
+            else
+                eeprom_write_byte((unsigned char*)eeprom_pos, value);
+        }
+    }
+    eeprom_pos++; // past the end the record is counted, the store then fails
 }
-#define EEPROM_WRITE_VAR(pos, value) _EEPROM_writeData(pos, (uint8_t*)&value, sizeof(value))
-void _EEPROM_readData(int &pos, uint8_t* value, uint8_t size)
+
+void _EEPROM_writeField(uint8_t id, uint8_t* value, uint8_t size)
 {
+    _EEPROM_putByte(id);
+    _EEPROM_putByte(size);
     do
     {
-        *value = eeprom_read_byte((unsigned char*)pos);
-        pos++;
+        _EEPROM_putByte(*value);
         value++;
     }while(--size);
 }
-#define EEPROM_READ_VAR(pos, value) _EEPROM_readData(pos, (uint8_t*)&value, sizeof(value))
-//======================================================================================
-
-
-
-
-#define EEPROM_OFFSET 100
+#define EEPROM_WRITE_VAR(id, value) _EEPROM_writeField(id, (uint8_t*)&value, sizeof(value))
 
+// Read a field of the slot at base into value, if it is there with the same size
+bool _EEPROM_readField(int base, uint8_t id, uint8_t* value, uint8_t size)
+{
+    int pos = base + EEPROM_HEADER_SIZE;
+    int end = pos + eeprom_read_word((uint16_t*)(base + 3));
+    while (pos + 2 <= end)
+    {
+        uint8_t field_id = eeprom_read_byte((unsigned char*)pos);
+        uint8_t field_size = eeprom_read_byte((unsigned char*)pos + 1);
+        pos += 2;
+        if (field_id == id)
+        {
+            if (field_size != size) return false;
+            eeprom_read_block(value, (void*)pos, size);
+            return true;
+        }
+        pos += field_size;
+    }
+    return false;
+}
+#define EEPROM_READ_VAR(base, id, value) _EEPROM_readField(base, id, (uint8_t*)&value, sizeof(value))
 
-// IMPORTANT:  Whenever there are changes made to the variables stored in EEPROM
-// in the functions below, also increment the version number. This makes sure that
-// the default values are used whenever there is a change to the data, to prevent
-// wrong data being written to the variables.
-// ALSO:  always make sure the variables in the Store and retrieve sections are in the same order.
+static bool _EEPROM_slotValid(int base)
+{
+    if (eeprom_read_byte((unsigned char*)base) != EEPROM_FORMAT) return false;
+    uint16_t length = eeprom_read_word((uint16_t*)(base + 3));
+    if (length > EEPROM_SLOT_SIZE - EEPROM_HEADER_SIZE) return false;
+    uint16_t crc = 0;
+    for (int pos = base + EEPROM_HEADER_SIZE; pos < base + EEPROM_HEADER_SIZE + length; pos++)
+        crc = _crc16_update(crc, eeprom_read_byte((unsigned char*)pos));
+    return crc == eeprom_read_word((uint16_t*)(base + 5));
+}
 
-#define EEPROM_VERSION "V13"
+// The slot with the newest valid settings, -1 if there are none
+static int8_t _EEPROM_newestSlot(uint16_t &sequence)
+{
+    int8_t newest = -1;
+    for (uint8_t slot = 0; slot < EEPROM_SLOTS; slot++)
+    {
+        int base = EEPROM_OFFSET + slot * EEPROM_SLOT_SIZE;
+        if (!_EEPROM_slotValid(base)) continue;
+        uint16_t seq = eeprom_read_word((uint16_t*)(base + 1));
+        if (newest < 0 || (int16_t)(seq - sequence) > 0)
+        {
+            newest = slot;
+            sequence = seq;
+        }
+    }
+    return newest;
+}
 
-#ifdef EEPROM_SETTINGS
-void Config_StoreSettings() 
+static void _EEPROM_writeFields()
 {
-  char ver[4]= "000";
-  int i=EEPROM_OFFSET;
-  EEPROM_WRITE_VAR(i,ver); // invalidate data first 
-  EEPROM_WRITE_VAR(i,axis_steps_per_unit);
-  EEPROM_WRITE_VAR(i,max_feedrate);  
-  EEPROM_WRITE_VAR(i,max_acceleration_units_per_sq_second);
-  EEPROM_WRITE_VAR(i,acceleration);
-  EEPROM_WRITE_VAR(i,retract_acceleration);
-  EEPROM_WRITE_VAR(i,minimumfeedrate);
-  EEPROM_WRITE_VAR(i,mintravelfeedrate);
-  EEPROM_WRITE_VAR(i,minsegmenttime);
-  EEPROM_WRITE_VAR(i,max_xy_jerk);
-  EEPROM_WRITE_VAR(i,max_z_jerk);
-  EEPROM_WRITE_VAR(i,max_e_jerk);
-  EEPROM_WRITE_VAR(i,add_homing);
+  EEPROM_WRITE_VAR(EE_STEPS_PER_UNIT, axis_steps_per_unit);
+  EEPROM_WRITE_VAR(EE_MAX_FEEDRATE, max_feedrate);
+  EEPROM_WRITE_VAR(EE_MAX_ACCELERATION, max_acceleration_units_per_sq_second);
+  EEPROM_WRITE_VAR(EE_ACCELERATION, acceleration);
+  EEPROM_WRITE_VAR(EE_RETRACT_ACCELERATION, retract_acceleration);
+  EEPROM_WRITE_VAR(EE_MINIMUMFEEDRATE, minimumfeedrate);
+  EEPROM_WRITE_VAR(EE_MINTRAVELFEEDRATE, mintravelfeedrate);
+  EEPROM_WRITE_VAR(EE_MINSEGMENTTIME, minsegmenttime);
+  EEPROM_WRITE_VAR(EE_MAX_XY_JERK, max_xy_jerk);
+  EEPROM_WRITE_VAR(EE_MAX_Z_JERK, max_z_jerk);
+  EEPROM_WRITE_VAR(EE_MAX_E_JERK, max_e_jerk);
+  EEPROM_WRITE_VAR(EE_ADD_HOMING, add_homing);
   #ifdef DELTA
-  EEPROM_WRITE_VAR(i,endstop_adj);
-  EEPROM_WRITE_VAR(i,delta_radius);
-  EEPROM_WRITE_VAR(i,delta_diagonal_rod);
-  EEPROM_WRITE_VAR(i,delta_segments_per_second);
+  EEPROM_WRITE_VAR(EE_ENDSTOP_ADJ, endstop_adj);
+  EEPROM_WRITE_VAR(EE_DELTA_RADIUS, delta_radius);
+  EEPROM_WRITE_VAR(EE_DELTA_DIAGONAL_ROD, delta_diagonal_rod);
+  EEPROM_WRITE_VAR(EE_DELTA_SEGMENTS_PER_SECOND, delta_segments_per_second);
   #endif
-  #ifndef ULTIPANEL
-  int plaPreheatHotendTemp = PLA_PREHEAT_HOTEND_TEMP, plaPreheatHPBTemp = PLA_PREHEAT_HPB_TEMP, plaPreheatFanSpeed = PLA_PREHEAT_FAN_SPEED;
-  int absPreheatHotendTemp = ABS_PREHEAT_HOTEND_TEMP, absPreheatHPBTemp = ABS_PREHEAT_HPB_TEMP, absPreheatFanSpeed = ABS_PREHEAT_FAN_SPEED;
+  #ifdef ULTIPANEL
+  EEPROM_WRITE_VAR(EE_PLA_HOTEND_TEMP, plaPreheatHotendTemp);
+  EEPROM_WRITE_VAR(EE_PLA_HPB_TEMP, plaPreheatHPBTemp);
+  EEPROM_WRITE_VAR(EE_PLA_FAN_SPEED, plaPreheatFanSpeed);
+  EEPROM_WRITE_VAR(EE_ABS_HOTEND_TEMP, absPreheatHotendTemp);
+  EEPROM_WRITE_VAR(EE_ABS_HPB_TEMP, absPreheatHPBTemp);
+  EEPROM_WRITE_VAR(EE_ABS_FAN_SPEED, absPreheatFanSpeed);
   #endif
-  EEPROM_WRITE_VAR(i,plaPreheatHotendTemp);
-  EEPROM_WRITE_VAR(i,plaPreheatHPBTemp);
-  EEPROM_WRITE_VAR(i,plaPreheatFanSpeed);
-  EEPROM_WRITE_VAR(i,absPreheatHotendTemp);
-  EEPROM_WRITE_VAR(i,absPreheatHPBTemp);
-  EEPROM_WRITE_VAR(i,absPreheatFanSpeed);
-  EEPROM_WRITE_VAR(i,zprobe_zoffset);
+  EEPROM_WRITE_VAR(EE_ZPROBE_ZOFFSET, zprobe_zoffset);
   #ifdef PIDTEMP
-    EEPROM_WRITE_VAR(i,Kp);
-    EEPROM_WRITE_VAR(i,Ki);
-    EEPROM_WRITE_VAR(i,Kd);
-  #else
-		float dummy = 3000.0f;
-    EEPROM_WRITE_VAR(i,dummy);
-		dummy = 0.0f;
-    EEPROM_WRITE_VAR(i,dummy);
-    EEPROM_WRITE_VAR(i,dummy);
+    EEPROM_WRITE_VAR(EE_KP, Kp);
+    EEPROM_WRITE_VAR(EE_KI, Ki);
+    EEPROM_WRITE_VAR(EE_KD, Kd);
+    #ifdef PID_ADD_EXTRUSION_RATE
+    EEPROM_WRITE_VAR(EE_KC, Kc);
+    #endif
   #endif
-  #ifndef DOGLCD
-    int lcd_contrast = 32;
+  #ifdef PIDTEMPBED
+    EEPROM_WRITE_VAR(EE_BED_KP, bedKp);
+    EEPROM_WRITE_VAR(EE_BED_KI, bedKi);
+    EEPROM_WRITE_VAR(EE_BED_KD, bedKd);
+  #endif
+  #ifdef DOGLCD
+  EEPROM_WRITE_VAR(EE_LCD_CONTRAST, lcd_contrast);
   #endif
-  EEPROM_WRITE_VAR(i,lcd_contrast);
   #ifdef SCARA
-  EEPROM_WRITE_VAR(i,axis_scaling);        // Add scaling for SCARA
+  EEPROM_WRITE_VAR(EE_AXIS_SCALING, axis_scaling);        // Add scaling for SCARA
   #endif
   #ifdef FWRETRACT
-  EEPROM_WRITE_VAR(i,autoretract_enabled);
-  EEPROM_WRITE_VAR(i,retract_length);
+  EEPROM_WRITE_VAR(EE_AUTORETRACT_ENABLED, autoretract_enabled);
+  EEPROM_WRITE_VAR(EE_RETRACT_LENGTH, retract_length);
   #if EXTRUDERS > 1
-  EEPROM_WRITE_VAR(i,retract_length_swap);
+  EEPROM_WRITE_VAR(EE_RETRACT_LENGTH_SWAP, retract_length_swap);
   #endif
-  EEPROM_WRITE_VAR(i,retract_feedrate);
-  EEPROM_WRITE_VAR(i,retract_zlift);
-  EEPROM_WRITE_VAR(i,retract_recover_length);
+  EEPROM_WRITE_VAR(EE_RETRACT_FEEDRATE, retract_feedrate);
+  EEPROM_WRITE_VAR(EE_RETRACT_ZLIFT, retract_zlift);
+  EEPROM_WRITE_VAR(EE_RETRACT_RECOVER_LENGTH, retract_recover_length);
   #if EXTRUDERS > 1
-  EEPROM_WRITE_VAR(i,retract_recover_length_swap);
+  EEPROM_WRITE_VAR(EE_RETRACT_RECOVER_LENGTH_SWAP, retract_recover_length_swap);
   #endif
-  EEPROM_WRITE_VAR(i,retract_recover_feedrate);
+  EEPROM_WRITE_VAR(EE_RETRACT_RECOVER_FEEDRATE, retract_recover_feedrate);
   #endif
 
   // Save filament sizes
-  EEPROM_WRITE_VAR(i, volumetric_enabled);
-  EEPROM_WRITE_VAR(i, filament_size[0]);
-  #if EXTRUDERS > 1
-  EEPROM_WRITE_VAR(i, filament_size[1]);
-  #if EXTRUDERS > 2
-  EEPROM_WRITE_VAR(i, filament_size[2]);
+  EEPROM_WRITE_VAR(EE_VOLUMETRIC_ENABLED, volumetric_enabled);
+  for (uint8_t e = 0; e < EXTRUDERS; e++)
+    EEPROM_WRITE_VAR(EE_FILAMENT_SIZE + e, filament_size[e]);
+
+  #ifdef VOLUMETRIC_FLOW_LIMIT
+  for (uint8_t e = 0; e < EXTRUDERS; e++)
+    EEPROM_WRITE_VAR(EE_MAX_VOLUMETRIC_FLOW + e, max_volumetric_flow[e]);
   #endif
+
+  #ifdef AUTO_BED_LEVELING_MESH
+  EEPROM_WRITE_VAR(EE_MESH_VALID, mesh_valid);
+  for (int8_t y = 0; y < AUTO_BED_LEVELING_GRID_POINTS; y++)
+    EEPROM_WRITE_VAR(EE_MESH_ROW + y, mesh_z_values[y]); // one row at a time, a whole mesh can exceed the 255 byte limit
   #endif
-  
-  char ver2[4]=EEPROM_VERSION;
-  i=EEPROM_OFFSET;
-  EEPROM_WRITE_VAR(i,ver2); // validate data
+}
+
+// Put the fields into a slot, or only compare them with it. Returns the length of the fields.
+static int _EEPROM_putFields(int base, bool compare)
+{
+  eeprom_pos = base + EEPROM_HEADER_SIZE;
+  eeprom_end = base + EEPROM_SLOT_SIZE;
+  eeprom_crc = 0;
+  eeprom_compare = compare;
+  eeprom_differs = false;
+  _EEPROM_writeFields();
+  return eeprom_pos - (base + EEPROM_HEADER_SIZE);
+}
+
+static void _EEPROM_updateByte(int pos, uint8_t value)
+{
+  if (eeprom_read_byte((unsigned char*)pos) != value) eeprom_write_byte((unsigned char*)pos, value);
+}
+
+void Config_StoreSettings() 
+{
+  uint16_t sequence = 0;
+  int8_t newest = _EEPROM_newestSlot(sequence);
+  if (newest >= 0)
+  {
+    // Nothing changed since the last M500, leave the EEPROM alone
+    int base = EEPROM_OFFSET + newest * EEPROM_SLOT_SIZE;
+    int length = _EEPROM_putFields(base, true);
+    if (!eeprom_differs && length == (int)eeprom_read_word((uint16_t*)(base + 3)))
+    {
+      SERIAL_ECHO_START;
+      SERIAL_ECHOLNPGM("Settings Stored");
+      return;
+    }
+  }
+
+  uint8_t slot = (newest + 1) % EEPROM_SLOTS;
+  int base = EEPROM_OFFSET + slot * EEPROM_SLOT_SIZE;
+  _EEPROM_updateByte(base, 0xFF); // invalidate the slot first, the newest one stays valid until the end
+  int length = _EEPROM_putFields(base, false);
+  if (length > EEPROM_SLOT_SIZE - EEPROM_HEADER_SIZE)
+  {
+    SERIAL_ERROR_START;
+    SERIAL_ERRORLNPGM(MSG_ERR_EEPROM_SLOT_TOO_SMALL);
+    return;
+  }
+  sequence++;
+  _EEPROM_updateByte(base + 1, sequence & 0xFF);
+  _EEPROM_updateByte(base + 2, sequence >> 8);
+  _EEPROM_updateByte(base + 3, length & 0xFF);
+  _EEPROM_updateByte(base + 4, length >> 8);
+  _EEPROM_updateByte(base + 5, eeprom_crc & 0xFF);
+  _EEPROM_updateByte(base + 6, eeprom_crc >> 8);
+  _EEPROM_updateByte(base, EEPROM_FORMAT); // validate data
   SERIAL_ECHO_START;
   SERIAL_ECHOLNPGM("Settings Stored");
 }
@@ -214,6 +353,18 @@ SERIAL_ECHOLNPGM("Scaling factors:");
     SERIAL_ECHOPAIR("   M301 P",Kp); 
     SERIAL_ECHOPAIR(" I" ,unscalePID_i(Ki)); 
     SERIAL_ECHOPAIR(" D" ,unscalePID_d(Kd));
+    #ifdef PID_ADD_EXTRUSION_RATE
+    SERIAL_ECHOPAIR(" C" ,Kc);
+    #endif
+    SERIAL_ECHOLN(""); 
+#endif
+#ifdef PIDTEMPBED
+    SERIAL_ECHO_START;
+    SERIAL_ECHOLNPGM("Bed PID settings:");
+    SERIAL_ECHO_START;
+    SERIAL_ECHOPAIR("   M304 P",bedKp); 
+    SERIAL_ECHOPAIR(" I" ,unscalePID_i(bedKi)); 
+    SERIAL_ECHOPAIR(" D" ,unscalePID_d(bedKd));
     SERIAL_ECHOLN(""); 
 #endif
 #ifdef FWRETRACT
@@ -265,6 +416,16 @@ SERIAL_ECHOLNPGM("Scaling factors:");
         SERIAL_ECHOLNPGM("Filament settings: Disabled");
     }
 #endif
+#ifdef VOLUMETRIC_FLOW_LIMIT
+    SERIAL_ECHO_START;
+    SERIAL_ECHOLNPGM("Maximum volumetric flow (mm3/s, mm/s without M200), 0 = no limit:");
+    for (uint8_t e = 0; e < EXTRUDERS; e++) {
+        SERIAL_ECHO_START;
+        SERIAL_ECHOPAIR("   M213 T", (unsigned long)e);
+        SERIAL_ECHOPAIR(" S", max_volumetric_flow[e]);
+        SERIAL_ECHOLN("");
+    }
+#endif
 }
 #endif
 
@@ -272,85 +433,104 @@ SERIAL_ECHOLNPGM("Scaling factors:");
 #ifdef EEPROM_SETTINGS
 void Config_RetrieveSettings()
 {
-    int i=EEPROM_OFFSET;
-    char stored_ver[4];
-    char ver[4]=EEPROM_VERSION;
-    EEPROM_READ_VAR(i,stored_ver); //read stored version
-    //  SERIAL_ECHOLN("Version: [" << ver << "] Stored version: [" << stored_ver << "]");
-    if (strncmp(ver,stored_ver,3) == 0)
+    uint16_t sequence = 0;
+    int8_t newest = _EEPROM_newestSlot(sequence);
+    if (newest >= 0)
     {
-        // version number match
-        EEPROM_READ_VAR(i,axis_steps_per_unit);
-        EEPROM_READ_VAR(i,max_feedrate);  
-        EEPROM_READ_VAR(i,max_acceleration_units_per_sq_second);
+        int i = EEPROM_OFFSET + newest * EEPROM_SLOT_SIZE;
+        // Settings that are not in the EEPROM keep their defaults
+        Config_LoadDefaults();
+
+        EEPROM_READ_VAR(i, EE_STEPS_PER_UNIT, axis_steps_per_unit);
+        EEPROM_READ_VAR(i, EE_MAX_FEEDRATE, max_feedrate);
+        EEPROM_READ_VAR(i, EE_MAX_ACCELERATION, max_acceleration_units_per_sq_second);
         
         // steps per sq second need to be updated to agree with the units per sq second (as they are what is used in the planner)
 		reset_acceleration_rates();
         
-        EEPROM_READ_VAR(i,acceleration);
-        EEPROM_READ_VAR(i,retract_acceleration);
-        EEPROM_READ_VAR(i,minimumfeedrate);
-        EEPROM_READ_VAR(i,mintravelfeedrate);
-        EEPROM_READ_VAR(i,minsegmenttime);
-        EEPROM_READ_VAR(i,max_xy_jerk);
-        EEPROM_READ_VAR(i,max_z_jerk);
-        EEPROM_READ_VAR(i,max_e_jerk);
-        EEPROM_READ_VAR(i,add_homing);
+        EEPROM_READ_VAR(i, EE_ACCELERATION, acceleration);
+        EEPROM_READ_VAR(i, EE_RETRACT_ACCELERATION, retract_acceleration);
+        EEPROM_READ_VAR(i, EE_MINIMUMFEEDRATE, minimumfeedrate);
+        EEPROM_READ_VAR(i, EE_MINTRAVELFEEDRATE, mintravelfeedrate);
+        EEPROM_READ_VAR(i, EE_MINSEGMENTTIME, minsegmenttime);
+        EEPROM_READ_VAR(i, EE_MAX_XY_JERK, max_xy_jerk);
+        EEPROM_READ_VAR(i, EE_MAX_Z_JERK, max_z_jerk);
+        EEPROM_READ_VAR(i, EE_MAX_E_JERK, max_e_jerk);
+        EEPROM_READ_VAR(i, EE_ADD_HOMING, add_homing);
         #ifdef DELTA
-		EEPROM_READ_VAR(i,endstop_adj);
-		EEPROM_READ_VAR(i,delta_radius);
-		EEPROM_READ_VAR(i,delta_diagonal_rod);
-		EEPROM_READ_VAR(i,delta_segments_per_second);
+		EEPROM_READ_VAR(i, EE_ENDSTOP_ADJ, endstop_adj);
+		EEPROM_READ_VAR(i, EE_DELTA_RADIUS, delta_radius);
+		EEPROM_READ_VAR(i, EE_DELTA_DIAGONAL_ROD, delta_diagonal_rod);
+		EEPROM_READ_VAR(i, EE_DELTA_SEGMENTS_PER_SECOND, delta_segments_per_second);
+		recalc_delta_settings(delta_radius, delta_diagonal_rod);
         #endif
-        #ifndef ULTIPANEL
-        int plaPreheatHotendTemp, plaPreheatHPBTemp, plaPreheatFanSpeed;
-        int absPreheatHotendTemp, absPreheatHPBTemp, absPreheatFanSpeed;
-        #endif
-        EEPROM_READ_VAR(i,plaPreheatHotendTemp);
-        EEPROM_READ_VAR(i,plaPreheatHPBTemp);
-        EEPROM_READ_VAR(i,plaPreheatFanSpeed);
-        EEPROM_READ_VAR(i,absPreheatHotendTemp);
-        EEPROM_READ_VAR(i,absPreheatHPBTemp);
-        EEPROM_READ_VAR(i,absPreheatFanSpeed);
-        EEPROM_READ_VAR(i,zprobe_zoffset);
-        #ifndef PIDTEMP
-        float Kp,Ki,Kd;
+        #ifdef ULTIPANEL
+        EEPROM_READ_VAR(i, EE_PLA_HOTEND_TEMP, plaPreheatHotendTemp);
+        EEPROM_READ_VAR(i, EE_PLA_HPB_TEMP, plaPreheatHPBTemp);
+        EEPROM_READ_VAR(i, EE_PLA_FAN_SPEED, plaPreheatFanSpeed);
+        EEPROM_READ_VAR(i, EE_ABS_HOTEND_TEMP, absPreheatHotendTemp);
+        EEPROM_READ_VAR(i, EE_ABS_HPB_TEMP, absPreheatHPBTemp);
+        EEPROM_READ_VAR(i, EE_ABS_FAN_SPEED, absPreheatFanSpeed);
         #endif
+        EEPROM_READ_VAR(i, EE_ZPROBE_ZOFFSET, zprobe_zoffset);
+        #ifdef PIDTEMP
         // do not need to scale PID values as the values in EEPROM are already scaled		
-        EEPROM_READ_VAR(i,Kp);
-        EEPROM_READ_VAR(i,Ki);
-        EEPROM_READ_VAR(i,Kd);
-        #ifndef DOGLCD
-        int lcd_contrast;
+        EEPROM_READ_VAR(i, EE_KP, Kp);
+        EEPROM_READ_VAR(i, EE_KI, Ki);
+        EEPROM_READ_VAR(i, EE_KD, Kd);
+        #ifdef PID_ADD_EXTRUSION_RATE
+        EEPROM_READ_VAR(i, EE_KC, Kc);
+        #endif
+        #endif
+        #ifdef PIDTEMPBED
+        EEPROM_READ_VAR(i, EE_BED_KP, bedKp);
+        EEPROM_READ_VAR(i, EE_BED_KI, bedKi);
+        EEPROM_READ_VAR(i, EE_BED_KD, bedKd);
+        #endif
+        #ifdef DOGLCD
+        EEPROM_READ_VAR(i, EE_LCD_CONTRAST, lcd_contrast);
         #endif
-        EEPROM_READ_VAR(i,lcd_contrast);
 		#ifdef SCARA
-		EEPROM_READ_VAR(i,axis_scaling);
+		EEPROM_READ_VAR(i, EE_AXIS_SCALING, axis_scaling);
 		#endif
 
 		#ifdef FWRETRACT
-		EEPROM_READ_VAR(i,autoretract_enabled);
-		EEPROM_READ_VAR(i,retract_length);
+		EEPROM_READ_VAR(i, EE_AUTORETRACT_ENABLED, autoretract_enabled);
+		EEPROM_READ_VAR(i, EE_RETRACT_LENGTH, retract_length);
 		#if EXTRUDERS > 1
-		EEPROM_READ_VAR(i,retract_length_swap);
+		EEPROM_READ_VAR(i, EE_RETRACT_LENGTH_SWAP, retract_length_swap);
 		#endif
-		EEPROM_READ_VAR(i,retract_feedrate);
-		EEPROM_READ_VAR(i,retract_zlift);
-		EEPROM_READ_VAR(i,retract_recover_length);
+		EEPROM_READ_VAR(i, EE_RETRACT_FEEDRATE, retract_feedrate);
+		EEPROM_READ_VAR(i, EE_RETRACT_ZLIFT, retract_zlift);
+		EEPROM_READ_VAR(i, EE_RETRACT_RECOVER_LENGTH, retract_recover_length);
 		#if EXTRUDERS > 1
-		EEPROM_READ_VAR(i,retract_recover_length_swap);
+		EEPROM_READ_VAR(i, EE_RETRACT_RECOVER_LENGTH_SWAP, retract_recover_length_swap);
 		#endif
-		EEPROM_READ_VAR(i,retract_recover_feedrate);
+		EEPROM_READ_VAR(i, EE_RETRACT_RECOVER_FEEDRATE, retract_recover_feedrate);
 		#endif
 
-		EEPROM_READ_VAR(i, volumetric_enabled);
-		EEPROM_READ_VAR(i, filament_size[0]);
-#if EXTRUDERS > 1
-		EEPROM_READ_VAR(i, filament_size[1]);
-#if EXTRUDERS > 2
-		EEPROM_READ_VAR(i, filament_size[2]);
-#endif
-#endif
+		EEPROM_READ_VAR(i, EE_VOLUMETRIC_ENABLED, volumetric_enabled);
+		for (uint8_t e = 0; e < EXTRUDERS; e++)
+			EEPROM_READ_VAR(i, EE_FILAMENT_SIZE + e, filament_size[e]);
+
+		#ifdef VOLUMETRIC_FLOW_LIMIT
+		for (uint8_t e = 0; e < EXTRUDERS; e++)
+			EEPROM_READ_VAR(i, EE_MAX_VOLUMETRIC_FLOW + e, max_volumetric_flow[e]);
+		#endif
+
+		#ifdef AUTO_BED_LEVELING_MESH
+		// current_position is compensated with the mesh being replaced, leave that frame first
+		bool mesh_was_active = mesh_active;
+		set_mesh_active(false);
+		EEPROM_READ_VAR(i, EE_MESH_VALID, mesh_valid);
+		for (int8_t y = 0; y < AUTO_BED_LEVELING_GRID_POINTS; y++)
+			if (!EEPROM_READ_VAR(i, EE_MESH_ROW + y, mesh_z_values[y]))
+				mesh_valid = false; // the grid changed
+		if (mesh_was_active) {
+			set_mesh_active(mesh_valid);
+			plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
+		}
+		#endif
 		calculate_volumetric_multipliers();
 		// Call updatePID (similar to when we have processed M301)
 		updatePID();
@@ -359,6 +539,14 @@ void Config_RetrieveSettings()
     }
     else
     {
+        // A slot was written but none passes the CRC check
+        for (uint8_t slot = 0; slot < EEPROM_SLOTS; slot++)
+            if (eeprom_read_byte((unsigned char*)(EEPROM_OFFSET + slot * EEPROM_SLOT_SIZE)) == EEPROM_FORMAT)
+            {
+                SERIAL_ERROR_START;
+                SERIAL_ERRORLNPGM(MSG_ERR_EEPROM_CORRUPT);
+                break;
+            }
         Config_ResetDefault();
     }
     #ifdef EEPROM_CHITCHAT
@@ -367,7 +555,8 @@ void Config_RetrieveSettings()
 }
 #endif
 
-void Config_ResetDefault()
+// Set all settings to the values of the configuration
+static void Config_LoadDefaults()
 {
     float tmp1[]=DEFAULT_AXIS_STEPS_PER_UNIT;
     float tmp2[]=DEFAULT_MAX_FEEDRATE;
@@ -412,6 +601,14 @@ void Config_ResetDefault()
 #ifdef ENABLE_AUTO_BED_LEVELING
     zprobe_zoffset = -Z_PROBE_OFFSET_FROM_EXTRUDER;
 #endif
+#ifdef AUTO_BED_LEVELING_MESH
+    if (mesh_active) {
+        // leave the compensated frame before the mesh is dropped
+        set_mesh_active(false);
+        plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
+    }
+    mesh_valid = false;
+#endif
 #ifdef DOGLCD
     lcd_contrast = DEFAULT_LCD_CONTRAST;
 #endif
@@ -427,6 +624,12 @@ void Config_ResetDefault()
     Kc = DEFAULT_Kc;
 #endif//PID_ADD_EXTRUSION_RATE
 #endif//PIDTEMP
+#ifdef PIDTEMPBED
+    bedKp = DEFAULT_bedKp;
+    bedKi = scalePID_i(DEFAULT_bedKi);
+    bedKd = scalePID_d(DEFAULT_bedKd);
+    updatePID();
+#endif//PIDTEMPBED
 
 #ifdef FWRETRACT
 	autoretract_enabled = false;
@@ -453,6 +656,15 @@ void Config_ResetDefault()
 #endif
 	calculate_volumetric_multipliers();
 
+#ifdef VOLUMETRIC_FLOW_LIMIT
+	for (uint8_t e = 0; e < EXTRUDERS; e++)
+		max_volumetric_flow[e] = DEFAULT_MAX_VOLUMETRIC_FLOW;
+#endif
+}
+
+void Config_ResetDefault()
+{
+Config_LoadDefaults();
 SERIAL_ECHO_START;
 SERIAL_ECHOLNPGM("Hardcoded Default Settings Loaded");
 
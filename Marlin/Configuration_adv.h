@@ -19,14 +19,52 @@
 //#define WATCH_TEMP_INCREASE 10  //Heat up at least 10 degree in 20 seconds
 
 #ifdef PIDTEMP
-  // this adds an experimental additional term to the heating power, proportional to the extrusion speed.
-  // if Kc is chosen well, the additional required power due to increased melting should be compensated.
+  // this adds an experimental additional term to the heating power, proportional to the extrusion rate.
+  // The rate is the filament volume per second of the moves queued in the planner, so the heater starts
+  // to work before the flow goes up. If Kc is chosen well, the additional power needed for melting is compensated.
+  // Without volumetric extrusion (M200) the filament is taken to be DEFAULT_NOMINAL_FILAMENT_DIA thick.
+  // Set with M301 C, stored in EEPROM.
   #define PID_ADD_EXTRUSION_RATE
   #ifdef PID_ADD_EXTRUSION_RATE
-    #define  DEFAULT_Kc (1) //heating power=Kc*(e_speed)
+    #define  DEFAULT_Kc (1) //heating power=Kc*(e_rate), PWM (0-255) per mm^3/s
   #endif
 #endif
 
+// Drive the heaters from the hardware PWM of their pins where the pin has a free timer channel, instead of
+// switching them in the temperature interrupt. Heaters on other pins keep the soft PWM. Not for relays (SLOW_PWM_HEATERS).
+//#define HEATER_HARDWARE_PWM
+
+// Heater power budget: limit the total power of the hotends and the bed to what the power supply can deliver.
+// The heater farthest below its target gets the power it asks for first, the others share what is left.
+// Needs EXTRUDER_WATTS and BED_WATTS in Configuration.h
+//#define HEATER_POWER_BUDGET 250 // W
+
+// ADC engine: convert the temperature (and filament width) inputs back to back from the ADC interrupt instead of
+// one conversion every other tick of the temperature interrupt. Every channel is summed over OVERSAMPLENR conversions
+// (about 10ms for all of them) and filtered, and the newest values go to the heater control every ADC_PUBLISH_TICKS
+// ticks of 1.024ms instead of every 164ms. PID_dT follows ADC_PUBLISH_TICKS, so re-run M303 after enabling this.
+//#define ADC_FREE_RUNNING
+#ifdef ADC_FREE_RUNNING
+  #define ADC_PUBLISH_TICKS 40  // 41ms, up to 255
+  // Filter on top of the summed conversions: 0 = none, 1 = median of the last 3 sums (drops single spikes),
+  // 2 = low pass that weights a new sum by 1/2^ADC_IIR_SHIFT
+  #define ADC_FILTER_HOTEND 1
+  #define ADC_FILTER_BED 2
+  #define ADC_FILTER_FILWIDTH 2
+  #define ADC_IIR_SHIFT 2
+#endif
+
+// Heater log: keep the temperature, target, power and PID terms of every heater in RAM, one entry every
+// HEATER_LOG_INTERVAL. Recording stops at the first MAXTEMP, MINTEMP, thermal runaway or "Heating failed",
+// which gets an entry of its own, so the lead-up to the fault is kept. The log is printed when the fault stops it,
+// and written to the SD card if no file is open. M305 prints the log, M305 S1 writes it to the SD card and
+// M305 R clears it. Each entry takes 6 + 11 bytes per heater of RAM.
+//#define HEATER_EVENT_LOG
+#ifdef HEATER_EVENT_LOG
+  #define HEATER_LOG_SIZE 24
+  #define HEATER_LOG_INTERVAL 2000 // ms between entries, 24 entries cover the last 48 s before the fault
+#endif
+
 
 //automatic temperature: The hot end target temperature is calculated by all the buffered lines of gcode.
 //The maximum buffered steps/sec of the extruder motor are called "se".
@@ -44,6 +82,31 @@
 //The M105 command return, besides traditional information, the ADC value read from temperature sensors.
 //#define SHOW_TEMP_ADC_VALUES
 
+// Thermal simulation: the temperature readings come from a model of the heaters instead of the ADC.
+// The model is driven by the heater PWM, so PID settings, M303 and the thermal protections can be tried
+// without heating anything. The heater outputs stay off.
+//#define THERMAL_SIMULATION
+#ifdef THERMAL_SIMULATION
+  #define SIM_AMBIENT_TEMP 25.0           // degC
+  #ifdef EXTRUDER_WATTS
+    #define SIM_HOTEND_WATTS EXTRUDER_WATTS
+  #else
+    #define SIM_HOTEND_WATTS 40.0         // heater power at full duty (W)
+  #endif
+  #define SIM_HOTEND_HEAT_CAPACITY 10.0   // heater block and nozzle (J/K)
+  #define SIM_HOTEND_LOSS 0.15            // heat lost to the ambient (W/K)
+  #define SIM_HOTEND_FAN_LOSS 0.10        // additional loss with the part cooling fan at full speed (W/K)
+  #define SIM_HOTEND_SENSOR_LAG 2.0       // time constant of the thermistor following the heater block (s)
+  #ifdef BED_WATTS
+    #define SIM_BED_WATTS BED_WATTS
+  #else
+    #define SIM_BED_WATTS 130.0
+  #endif
+  #define SIM_BED_HEAT_CAPACITY 900.0
+  #define SIM_BED_LOSS 1.0
+  #define SIM_BED_SENSOR_LAG 10.0
+#endif
+
 //  extruder run-out prevention.
 //if the machine is idle, and the temperature over MINTEMP, every couple of SECONDS some filament is extruded
 //#define EXTRUDER_RUNOUT_PREVENT
@@ -88,6 +151,11 @@
 
 #define ENDSTOPS_ONLY_FOR_HOMING // If defined the endstops will only be used for homing
 
+// Check the endstops on pin change interrupts instead of sampling them on every stepper interrupt.
+// An edge is confirmed by the next stepper interrupt; M119 reports the trigger positions.
+// Endstop pins without a pin change or external interrupt are still polled.
+//#define ENDSTOP_INTERRUPTS_FEATURE
+
 
 //// AUTOSET LOCATIONS OF LIMIT SWITCHES
 //// Added by ZetaPhoenix 09-15-2012
@@ -217,6 +285,10 @@
 #define Y_HOME_RETRACT_MM 5
 #define Z_HOME_RETRACT_MM 2
 //#define QUICK_HOME  //if this is defined, if both x and y are to be homed, a diagonal move will be performed initially.
+//#define PARALLEL_HOMING  //if this is defined, X and Y (and Z when it homes away from the bed) are homed together, fast moves and bumps alike.
+                           //Each axis stops on its own endstop. The axes share one move, so an axis only keeps its own homing
+                           //feedrate if it would not run further than 1.5 * its length while the slowest axis homes, otherwise it
+                           //is slowed down to finish with that axis. Supersedes QUICK_HOME.
 
 #define AXIS_RELATIVE_MODES {false, false, false, false}
 #ifdef CONFIG_STEPPERS_TOSHIBA
@@ -249,6 +321,14 @@
 // minimum time in microseconds that a movement needs to take if the buffer is emptied.
 #define DEFAULT_MINSEGMENTTIME        20000
 
+// Volumetric flow limit: printing moves are slowed down so an extruder does not push more filament per second
+// than its hotend can melt. Set per extruder with M213 T<extruder> S<mm^3/s> (S0 removes the limit), stored in EEPROM.
+// Without volumetric extrusion (M200) the filament is taken to be DEFAULT_NOMINAL_FILAMENT_DIA thick.
+//#define VOLUMETRIC_FLOW_LIMIT
+#ifdef VOLUMETRIC_FLOW_LIMIT
+  #define DEFAULT_MAX_VOLUMETRIC_FLOW 12 // mm^3/s, for all extruders
+#endif
+
 // If defined the movements slow down when the look ahead buffer is only half full
 #define SLOWDOWN
 
@@ -282,6 +362,33 @@
 // actual motor currents in Amps, need as many here as DIGIPOT_I2C_NUM_CHANNELS
 #define DIGIPOT_I2C_MOTOR_CURRENTS {1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0}
 
+// TMC26X stepper drivers (TMC260, TMC261, TMC262) configured over SPI. Needs the TMC26XStepper
+// library from ArduinoAddons/Arduino_1.6.x, build with TMC26X=1. Microstepping is taken from MICROSTEP_MODES.
+//#define HAVE_TMC26X
+#ifdef HAVE_TMC26X
+  #define TMC26X_CS_PINS {-1,-1,-1,-1}           // chip select pins of X, Y, Z, E0, -1 if that driver is not a TMC26X
+  #define TMC26X_CURRENT {1000,1000,1000,1000}   // RMS motor current in mA
+  #define TMC26X_SENSE_RESISTOR 150              // sense resistor in mOhm
+  #define TMC26X_MOTOR_STEPS 200                 // full steps per revolution
+  #define TMC26X_STATUS_INTERVAL 1000            // ms in which every driver is checked for over temperature, shorts and open load
+
+  // StallGuard threshold, -64 to 63. Lower is more sensitive.
+  #define TMC26X_STALLGUARD_THRESHOLD {10,10,10,10}
+
+  // CoolStep lowers the current while the load is low. It is raised again when the StallGuard
+  // reading falls below TMC26X_COOLSTEP_LOWER_SG and lowered above LOWER_SG + SG_HYSTERESIS (0 to 480 each).
+  #define TMC26X_COOLSTEP
+  #define TMC26X_COOLSTEP_LOWER_SG 160
+  #define TMC26X_COOLSTEP_SG_HYSTERESIS 160
+  #define TMC26X_COOLSTEP_MIN_CURRENT 0          // 0 = half, 1 = a quarter of TMC26X_CURRENT
+
+  // Home X, Y and Z without endstop switches. Wire the SG_TST output of the driver to the endstop
+  // pin in the homing direction and set that endstop to not inverting, a stall then stops the axis
+  // like a switch. The homing feedrate has to be fast enough for the StallGuard readings to be valid,
+  // so these axes home with the first hit, without the retract and the slow bump.
+  //#define TMC26X_STALLGUARD_HOMING {true,true,false} // X, Y, Z
+#endif
+
 //===========================================================================
 //=============================Additional Features===========================
 //===========================================================================
@@ -311,6 +418,48 @@
   //#define PROGRESS_MSG_ONCE
 #endif
 
+// Graphical LCD (DOGLCD): only send the 16x8 pixel tiles that changed since the last update.
+// The display updates take much less main loop time, costs 128 bytes of RAM.
+//#define DOGLCD_DIRTY_TILES
+
+// Graphical LCD (DOGLCD): draw one page strip per call of lcd_update() instead of the whole screen
+// at once, and hold off drawing while the planner runs low on moves so the main loop can feed it.
+//#define DOGLCD_SLICED_UPDATE
+
+#ifdef DOGLCD_SLICED_UPDATE
+  #define LCD_YIELD_MOVES (BLOCK_BUFFER_SIZE / 4) // don't draw with fewer moves planned than this...
+  #define LCD_YIELD_MAX_MS 1000                   // ...unless the update is late by this much (ms)
+#endif
+
+// Character LCD (HD44780): draw into a copy of the character grid and send only the characters
+// that changed since the last update. Much less bus traffic, mostly on the I2C panels.
+//#define HD44780_SHADOW_BUFFER
+
+// Count the LCD updates, the time spent drawing and the bytes sent to the display, for M251.
+// Bytes are counted on the graphical displays and on character displays with HD44780_SHADOW_BUFFER.
+// LinuxAddons/lcd_simulator runs the menus on a PC with this on, for scripted tests of the menus.
+//#define LCD_RENDER_STATS
+
+// Time the stepper, temperature and serial interrupts and the main loop, with the longest run and
+// the worst stepper interrupt latency, for M253. Shows how close a board is to its step rate limit.
+//#define CPU_PROFILING
+
+// Count the times the planner runs empty while printing, so the steppers stop and wait for the next
+// move, the fewest moves queued and the time with fewer than PLANNER_LOW_BLOCKS moves queued, for M254.
+// A drain on purpose (M400, homing, heating up) and the idle time before a new job are not counted.
+//#define PLANNER_UNDERRUN_STATS
+#ifdef PLANNER_UNDERRUN_STATS
+  #define PLANNER_LOW_BLOCKS (BLOCK_BUFFER_SIZE / 4)
+  // A longer stop is only an underrun if commands were waiting or an SD print runs, else the machine was idle
+  #define PLANNER_UNDERRUN_MAX_IDLE 2000 // ms
+  //#define PLANNER_UNDERRUN_REPORT // echo each underrun with the idle time and the number of queued commands
+#endif
+
+// With EEPROM_SETTINGS, M500 writes the settings into the next of this many EEPROM slots, so each
+// byte gets written only every EEPROM_SLOTS saves. A slot has to hold all settings, with the mesh
+// of AUTO_BED_LEVELING_MESH that needs a few slots less.
+#define EEPROM_SLOTS 4
+
 // The hardware watchdog should reset the microcontroller disabling all outputs, in case the firmware gets stuck and doesn't do temperature regulation.
 //#define USE_WATCHDOG
 
@@ -460,6 +609,50 @@ const unsigned int dropsegments=5; //everything with less than this number of st
   #error "Bed Auto Leveling is still not compatible with Delta Kinematics."
 #endif
 
+#if defined (PARALLEL_HOMING) && (defined (COREXY) || defined (DELTA) || defined (SCARA) || defined (DUAL_X_CARRIAGE))
+  #error "PARALLEL_HOMING needs independent X, Y and Z motors and a single X carriage."
+#endif
+
+#if defined (AUTO_BED_LEVELING_MESH) && defined (SCARA)
+  #error "AUTO_BED_LEVELING_MESH is not compatible with SCARA Kinematics."
+#endif
+
+#if defined (HEATER_HARDWARE_PWM) && defined (SLOW_PWM_HEATERS)
+  #error "HEATER_HARDWARE_PWM cannot be used with SLOW_PWM_HEATERS."
+#endif
+
+#if defined (HEATER_POWER_BUDGET) && !(defined (EXTRUDER_WATTS) && defined (BED_WATTS))
+  #error "HEATER_POWER_BUDGET needs EXTRUDER_WATTS and BED_WATTS."
+#endif
+
+#if defined (LCD_RENDER_STATS) && !defined (ULTRA_LCD)
+  #error "LCD_RENDER_STATS needs an LCD."
+#endif
+
+#if defined(TMC26X_STALLGUARD_HOMING) && (defined(COREXY) || defined(DUAL_X_CARRIAGE) || defined(DELTA))
+  #error "TMC26X_STALLGUARD_HOMING is not supported with COREXY, DUAL_X_CARRIAGE or DELTA."
+#endif
+
+#if defined(TMC26X_STALLGUARD_HOMING) && !defined(ENDSTOPS_ONLY_FOR_HOMING)
+  #error "TMC26X_STALLGUARD_HOMING needs ENDSTOPS_ONLY_FOR_HOMING, a stall while printing would stop the move."
+#endif
+
+#if EEPROM_SLOTS < 1
+  #error "EEPROM_SLOTS has to be at least 1."
+#endif
+
+#if defined (HD44780_SHADOW_BUFFER) && defined (LANGUAGE_RU)
+  #error "HD44780_SHADOW_BUFFER cannot be used with LANGUAGE_RU, its UTF8 characters take more than one byte per cell."
+#endif
+
+#ifdef ADC_FREE_RUNNING
+  #if TEMP_SENSOR_0 == -2
+    #error "ADC_FREE_RUNNING cannot be used with a MAX6675 on heater 0."
+  #endif
+  #undef PID_dT
+  #define PID_dT (ADC_PUBLISH_TICKS / (F_CPU / 64.0 / 256.0))
+#endif
+
 #if EXTRUDERS > 1 && defined TEMP_SENSOR_1_AS_REDUNDANT
   #error "You cannot use TEMP_SENSOR_1_AS_REDUNDANT if EXTRUDERS > 1"
 #endif
@@ -105,6 +105,7 @@ FORCE_INLINE void serialprintPGM(const char *str)
 
 void get_command();
 void process_commands();
+uint8_t commands_queued(); // commands read but not processed yet
 
 void manage_inactivity(bool ignore_stepper_queue=false);
 
@@ -203,6 +204,9 @@ void refresh_cmd_timeout(void);
 void setPwmFrequency(uint8_t pin, int val);
 #endif
 
+// Compare register for hardware PWM on pin, NULL if its timer is not free. wide is set for 16 bit timers.
+volatile uint8_t *pwm_output_register(int8_t pin, bool &wide);
+
 #ifndef CRITICAL_SECTION_START
   #define CRITICAL_SECTION_START  unsigned char _sreg = SREG; cli();
   #define CRITICAL_SECTION_END    SREG = _sreg;
@@ -246,10 +250,7 @@ extern unsigned char fanSpeedSoftPwm;
   extern float filament_width_nominal;  //holds the theoretical filament diameter ie., 3.00 or 1.75
   extern bool filament_sensor;  //indicates that filament sensor readings should control extrusion
   extern float filament_width_meas; //holds the filament diameter as accurately measured
-  extern signed char measurement_delay[];  //ring buffer to delay measurement
-  extern int delay_index1, delay_index2;  //index into ring buffer
-  extern float delay_dist; //delay distance counter
-  extern int meas_delay_cm; //delay distance
+  extern float meas_delay_cm; //distance from the sensor to the melt zone
 #endif
 
 #ifdef FWRETRACT
@@ -270,6 +271,10 @@ extern void digipot_i2c_set_current( int channel, float current );
 extern void digipot_i2c_init();
 #endif
 
+#ifdef AUTO_BED_LEVELING_MESH
+void set_mesh_active(bool active);
+#endif
+
 #endif
 
 extern void calculate_volumetric_multipliers();
@@ -51,6 +51,11 @@
 #include <SPI.h>
 #endif
 
+#ifdef HAVE_TMC26X
+  #include <SPI.h>
+  #include <TMC26XStepper.h>
+#endif
+
 #if defined(DIGIPOT_I2C)
   #include <Wire.h>
 #endif
@@ -22,6 +22,7 @@
 
 #include "Marlin.h"
 #include "MarlinSerial.h"
+#include "profiling.h"
 
 #ifndef AT90USB
 // this next line disables the entire HardwareSerial.cpp, 
@@ -53,8 +54,10 @@ FORCE_INLINE void store_char(unsigned char c)
   //SIGNAL(SIG_USART_RECV)
   SIGNAL(M_USARTx_RX_vect)
   {
+    PROFILE_TIMER0_START;
     unsigned char c  =  M_UDRx;
     store_char(c);
+    PROFILE_TIMER0_END(PROFILE_SERIAL_RX);
   }
 #endif
 
@@ -44,6 +44,10 @@
 #include "cardreader.h"
 #include "watchdog.h"
 #include "ConfigurationStore.h"
+#include "filament_width.h"
+#include "scheduler.h"
+#include "profiling.h"
+#include "tmc26x.h"
 #include "language.h"
 #include "pins_arduino.h"
 #include "math.h"
@@ -122,10 +126,11 @@
 //        Rxxx Wait for extruder current temp to reach target temp. Waits when heating and cooling
 //        IF AUTOTEMP is enabled, S<mintemp> B<maxtemp> F<factor>. Exit autotemp by any M109 without F
 // M112 - Emergency stop
+// M116 - Heat all and wait: S<hotend temp> T<extruder> B<bed temp>, then wait until all heaters reached their targets
 // M114 - Output current position to serial port
 // M115 - Capabilities string
 // M117 - display message
-// M119 - Output Endstop status to serial port
+// M119 - Output Endstop status to serial port, and the positions where the endstops last triggered
 // M126 - Solenoid Air Valve Open (BariCUDA support by jmil)
 // M127 - Solenoid Air Valve Closed (BariCUDA vent to atmospheric pressure by jmil)
 // M128 - EtoP Open (BariCUDA EtoP = electricity to air pressure transducer by jmil)
@@ -144,23 +149,31 @@
 // M207 - set retract length S[positive mm] F[feedrate mm/min] Z[additional zlift/hop], stays in mm regardless of M200 setting
 // M208 - set recover=unretract length S[positive mm surplus to the M207 S*] F[feedrate mm/sec]
 // M209 - S<1=true/0=false> enable automatic retract detect if the slicer did not support G10/11: every normal extrude-only move will be classified as retract depending on the direction.
+// M213 T<extruder> S<mm^3/s> - Set the maximum volumetric flow of an extruder, S0 for no limit (VOLUMETRIC_FLOW_LIMIT)
 // M218 - set hotend offset (in mm): T<extruder_number> X<offset_on_X> Y<offset_on_Y>
 // M220 S<factor in percent>- set speed factor override percentage
 // M221 S<factor in percent>- set extrude factor override percentage
 // M226 P<pin number> S<pin state>- Wait until the specified pin reaches the state required
 // M240 - Trigger a camera to take a photograph
 // M250 - Set LCD contrast C<contrast value> (value 0..63)
+// M251 - Print the LCD render statistics (LCD_RENDER_STATS), R resets them
+// M252 - Print the run times of the main loop tasks, R resets them. T<task> S<ms> sets the period of a task, not of the heater and inactivity tasks
+// M253 - Print the time spent in the interrupts and the main loop (CPU_PROFILING), R resets it
+// M254 - Print the planner underrun statistics (PLANNER_UNDERRUN_STATS), R resets them
 // M280 - set servo position absolute. P: servo index, S: angle or microseconds
 // M300 - Play beep sound S<frequency Hz> P<duration ms>
 // M301 - Set PID parameters P I and D
 // M302 - Allow cold extrudes, or set the minimum extrude S<temperature>.
 // M303 - PID relay autotune S<temperature> sets the target temperature. (default target temperature = 150C)
+//        E<heater> (-1 for the bed), or A for all hotends together, with the bed at B<temperature> if given.
+//        C<cycles>, R<rule> 0 Ziegler-Nichols, 1 Tyreus-Luyben. U applies the gains and stores them.
 // M304 - Set bed PID parameters P I and D
+// M305 - Print the heater log (HEATER_EVENT_LOG), S1 writes it to HEATLOG.CSV on the SD card, R clears it
 // M400 - Finish all moves
 // M401 - Lower z-probe if present
 // M402 - Raise z-probe if present
 // M404 - N<dia in mm> Enter the nominal filament width (3mm, 1.75mm ) or will display nominal filament width without parameters
-// M405 - Turn on Filament Sensor extrusion control.  Optional D<delay in cm> to set delay in centimeters between sensor and extruder 
+// M405 - Turn on Filament Sensor extrusion control.  Optional D<delay in cm> to set delay in centimeters between sensor and extruder (fractions allowed)
 // M406 - Turn off Filament Sensor extrusion control 
 // M407 - Displays measured filament diameter 
 // M500 - stores parameters in EEPROM
@@ -331,11 +344,7 @@ bool cancel_heatup = false ;
   float filament_width_nominal=DEFAULT_NOMINAL_FILAMENT_DIA;  //Set nominal filament width, can be changed with M404 
   bool filament_sensor=false;  //M405 turns on filament_sensor control, M406 turns it off 
   float filament_width_meas=DEFAULT_MEASURED_FILAMENT_DIA; //Stores the measured filament diameter 
-  signed char measurement_delay[MAX_MEASUREMENT_DELAY+1];  //ring buffer to delay measurement  store extruder factor after subtracting 100 
-  int delay_index1=0;  //index into ring buffer
-  int delay_index2=-1;  //index into ring buffer - set to -1 on startup to indicate ring buffer needs to be initialized
-  float delay_dist=0; //delay distance counter  
-  int meas_delay_cm = MEASUREMENT_DELAY_CM;  //distance delay setting
+  float meas_delay_cm = MEASUREMENT_DELAY_CM;  //distance delay setting
 #endif
 
 const char errormagic[] PROGMEM = "Error:";
@@ -599,6 +608,7 @@ void setup()
   Config_RetrieveSettings();
 
   tp_init();    // Initialize temperature loop
+  scheduler_init(); // Register the main loop tasks
   plan_init();  // Initialize planner;
   watchdog_init();
   st_init();    // Initialize stepper, this enables interrupts!
@@ -626,6 +636,7 @@ void setup()
 
 void loop()
 {
+  PROFILE_LOOP_START;
   if(buflen < (BUFSIZE-1))
     get_command();
   #ifdef SDSUPPORT
@@ -664,11 +675,15 @@ void loop()
     buflen = (buflen-1);
     bufindr = (bufindr + 1)%BUFSIZE;
   }
-  //check heater every n milliseconds
-  manage_heater();
-  manage_inactivity();
-  checkHitEndstops();
-  lcd_update();
+  PROFILE_LOOP_MARK(PROFILE_COMMANDS);
+  // heaters, inactivity, endstop reports and the LCD
+  scheduler_run(true);
+  PROFILE_LOOP_MARK(PROFILE_TASKS);
+}
+
+uint8_t commands_queued()
+{
+  return buflen;
 }
 
 void get_command()
@@ -1047,11 +1062,25 @@ static void set_bed_level_equation_3pts(float z_at_pt_1, float z_at_pt_2, float
 
 #endif // AUTO_BED_LEVELING_GRID
 
+#ifdef AUTO_BED_LEVELING_MESH
+// Switch the mesh compensation on or off without moving the nozzle.
+// current_position[Z_AXIS] is converted to the new frame; call plan_set_position() afterwards.
+void set_mesh_active(bool active) {
+    if (active == mesh_active) return;
+    float z_offset = mesh_get_z_offset(current_position[X_AXIS], current_position[Y_AXIS]);
+    current_position[Z_AXIS] += active ? -z_offset : z_offset;
+    mesh_active = active;
+}
+#endif // AUTO_BED_LEVELING_MESH
+
 static void run_z_probe() {
     plan_bed_level_matrix.set_to_identity();
-    feedrate = homing_feedrate[Z_AXIS];
+#ifdef AUTO_BED_LEVELING_MESH
+    set_mesh_active(false); // probe in machine coordinates, the caller switches the mesh back on
+#endif
+    feedrate = Z_PROBE_FEEDRATE_FAST;
 
-    // move down until you find the bed
+    // move down quickly until you find the bed
     float zPosition = -10;
     plan_buffer_line(current_position[X_AXIS], current_position[Y_AXIS], zPosition, current_position[E_AXIS], feedrate/60, active_extruder);
     st_synchronize();
@@ -1060,14 +1089,14 @@ static void run_z_probe() {
     zPosition = st_get_position_mm(Z_AXIS);
     plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], zPosition, current_position[E_AXIS]);
 
-    // move up the retract distance
-    zPosition += home_retract_mm(Z_AXIS);
+    // move up the bump distance
+    zPosition += Z_PROBE_BUMP;
     plan_buffer_line(current_position[X_AXIS], current_position[Y_AXIS], zPosition, current_position[E_AXIS], feedrate/60, active_extruder);
     st_synchronize();
 
     // move back down slowly to find bed
-    feedrate = homing_feedrate[Z_AXIS]/4;
-    zPosition -= home_retract_mm(Z_AXIS) * 2;
+    feedrate = Z_PROBE_FEEDRATE_SLOW;
+    zPosition -= Z_PROBE_BUMP * 2;
     plan_buffer_line(current_position[X_AXIS], current_position[Y_AXIS], zPosition, current_position[E_AXIS], feedrate/60, active_extruder);
     st_synchronize();
 
@@ -1210,25 +1239,29 @@ static void homeaxis(int axis) {
       }
     #endif
 #endif // Z_PROBE_SLED
+    tmc26x_homing(1 << axis);
     destination[axis] = 1.5 * max_length(axis) * axis_home_dir;
     feedrate = homing_feedrate[axis];
     plan_buffer_line(destination[X_AXIS], destination[Y_AXIS], destination[Z_AXIS], destination[E_AXIS], feedrate/60, active_extruder);
     st_synchronize();
 
-    current_position[axis] = 0;
-    plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
-    destination[axis] = -home_retract_mm(axis) * axis_home_dir;
-    plan_buffer_line(destination[X_AXIS], destination[Y_AXIS], destination[Z_AXIS], destination[E_AXIS], feedrate/60, active_extruder);
-    st_synchronize();
+    // A StallGuard stall is not released again at the slow bump speed, that axis keeps the first hit
+    if (!tmc26x_stall_homing(axis)) {
+      current_position[axis] = 0;
+      plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
+      destination[axis] = -home_retract_mm(axis) * axis_home_dir;
+      plan_buffer_line(destination[X_AXIS], destination[Y_AXIS], destination[Z_AXIS], destination[E_AXIS], feedrate/60, active_extruder);
+      st_synchronize();
 
-    destination[axis] = 2*home_retract_mm(axis) * axis_home_dir;
+      destination[axis] = 2*home_retract_mm(axis) * axis_home_dir;
 #ifdef DELTA
-    feedrate = homing_feedrate[axis]/10;
+      feedrate = homing_feedrate[axis]/10;
 #else
-    feedrate = homing_feedrate[axis]/2 ;
+      feedrate = homing_feedrate[axis]/2 ;
 #endif
-    plan_buffer_line(destination[X_AXIS], destination[Y_AXIS], destination[Z_AXIS], destination[E_AXIS], feedrate/60, active_extruder);
-    st_synchronize();
+      plan_buffer_line(destination[X_AXIS], destination[Y_AXIS], destination[Z_AXIS], destination[E_AXIS], feedrate/60, active_extruder);
+      st_synchronize();
+    }
 #ifdef DELTA
     // retrace by the amount specified in endstop_adj
     if (endstop_adj[axis] * axis_home_dir < 0) {
@@ -1238,6 +1271,7 @@ static void homeaxis(int axis) {
       st_synchronize();
     }
 #endif
+    tmc26x_homing(0);
     axis_is_at_home(axis);
     destination[axis] = current_position[axis];
     feedrate = 0.0;
@@ -1260,6 +1294,105 @@ static void homeaxis(int axis) {
 }
 #define HOMEAXIS(LETTER) homeaxis(LETTER##_AXIS)
 
+#ifdef PARALLEL_HOMING
+// Move the axes in axis_mask by distance[axis] in one block. The move takes as long as the
+// slowest axis needs at speed[axis] (mm/min). With stretch the other axes are moved further
+// so that each runs at its own speed for that whole time, which only makes sense towards an endstop.
+// A stretched move never goes further than 1.5 * max_length(axis), as a single axis homing move,
+// so a fast axis that would have to go further runs slower than its own speed.
+static void homing_move_parallel(uint8_t axis_mask, float distance[3], const float speed[3], bool stretch) {
+  float move_time = 0;
+  for (int8_t axis = X_AXIS; axis <= Z_AXIS; axis++) {
+    if (axis_mask & (1 << axis)) move_time = max(move_time, fabs(distance[axis]) / speed[axis]);
+  }
+  if (move_time == 0) return;
+
+  float length = 0;
+  for (int8_t axis = X_AXIS; axis <= Z_AXIS; axis++) {
+    destination[axis] = current_position[axis];
+    if (axis_mask & (1 << axis)) {
+      if (stretch) distance[axis] = (distance[axis] < 0 ? -1 : 1) * min(speed[axis] * move_time, 1.5 * max_length(axis));
+      destination[axis] += distance[axis];
+      length += sq(distance[axis]);
+    }
+  }
+  feedrate = sqrt(length) / move_time;
+  plan_buffer_line(destination[X_AXIS], destination[Y_AXIS], destination[Z_AXIS], destination[E_AXIS], feedrate/60, active_extruder);
+  st_synchronize();
+
+  for (int8_t axis = X_AXIS; axis <= Z_AXIS; axis++) {
+    if (axis_mask & (1 << axis)) current_position[axis] = destination[axis];
+  }
+}
+
+// Home all axes in axis_mask (bits 1<<X_AXIS ...) together. The fast move and the slow bump are
+// each a single block in which every endstop stops only its own axis.
+static void homeaxes(uint8_t axis_mask) {
+  if (!HOMEAXIS_DO(X)) axis_mask &= ~(1 << X_AXIS);
+  if (!HOMEAXIS_DO(Y)) axis_mask &= ~(1 << Y_AXIS);
+  if (!HOMEAXIS_DO(Z)) axis_mask &= ~(1 << Z_AXIS);
+  if (axis_mask == 0) return;
+
+  float distance[3], speed[3];
+
+  for (int8_t axis = X_AXIS; axis <= Z_AXIS; axis++) {
+    if (axis_mask & (1 << axis)) {
+      current_position[axis] = 0;
+      #ifdef SERVO_ENDSTOPS
+        if (servo_endstops[axis] > -1) servos[servo_endstops[axis]].write(servo_endstop_angles[axis * 2]);
+      #endif
+      distance[axis] = 1.5 * max_length(axis) * home_dir(axis);
+      speed[axis] = homing_feedrate[axis];
+    }
+  }
+  plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
+
+  enable_endstops_single_axis(true);
+  tmc26x_homing(axis_mask);
+  homing_move_parallel(axis_mask, distance, speed, true);
+
+  // StallGuard axes keep their first hit, a stall is not released again at the slow bump speed
+  uint8_t bump_mask = axis_mask;
+  for (int8_t axis = X_AXIS; axis <= Z_AXIS; axis++) {
+    if (tmc26x_stall_homing(axis)) bump_mask &= ~(1 << axis);
+  }
+
+  // we are at the endstops now, back off all axes together
+  for (int8_t axis = X_AXIS; axis <= Z_AXIS; axis++) {
+    if (bump_mask & (1 << axis)) {
+      current_position[axis] = 0;
+      distance[axis] = -home_retract_mm(axis) * home_dir(axis);
+    }
+  }
+  plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
+  homing_move_parallel(bump_mask, distance, speed, false);
+
+  // and bump them slowly
+  for (int8_t axis = X_AXIS; axis <= Z_AXIS; axis++) {
+    if (bump_mask & (1 << axis)) {
+      distance[axis] = 2 * home_retract_mm(axis) * home_dir(axis);
+      speed[axis] = homing_feedrate[axis] / 2;
+    }
+  }
+  homing_move_parallel(bump_mask, distance, speed, true);
+  enable_endstops_single_axis(false);
+  tmc26x_homing(0);
+
+  for (int8_t axis = X_AXIS; axis <= Z_AXIS; axis++) {
+    if (axis_mask & (1 << axis)) {
+      axis_is_at_home(axis);
+      destination[axis] = current_position[axis];
+      axis_known_position[axis] = true;
+      #ifdef SERVO_ENDSTOPS
+        if (servo_endstops[axis] > -1) servos[servo_endstops[axis]].write(servo_endstop_angles[axis * 2 + 1]);
+      #endif
+    }
+  }
+  feedrate = 0.0;
+  endstops_hit_on_purpose();
+}
+#endif // PARALLEL_HOMING
+
 void refresh_cmd_timeout(void)
 {
   previous_millis_cmd = millis();
@@ -1410,9 +1543,7 @@ void process_commands()
       codenum += millis();  // keep track of when we started waiting
       previous_millis_cmd = millis();
       while(millis() < codenum) {
-        manage_heater();
-        manage_inactivity();
-        lcd_update();
+        scheduler_run();
       }
       break;
       #ifdef FWRETRACT
@@ -1436,6 +1567,9 @@ void process_commands()
 #ifdef ENABLE_AUTO_BED_LEVELING
       plan_bed_level_matrix.set_to_identity();  //Reset the plane ("erase" all leveling data)
 #endif //ENABLE_AUTO_BED_LEVELING
+#ifdef AUTO_BED_LEVELING_MESH
+      set_mesh_active(false); // home in machine coordinates, the mesh is switched back on below
+#endif
 
       saved_feedrate = feedrate;
       saved_feedmultiply = feedmultiply;
@@ -1483,6 +1617,18 @@ void process_commands()
 
       home_all_axis = !((code_seen(axis_codes[X_AXIS])) || (code_seen(axis_codes[Y_AXIS])) || (code_seen(axis_codes[Z_AXIS])));
 
+      #ifdef PARALLEL_HOMING
+      {
+        uint8_t axis_mask = 0;
+        if((home_all_axis) || (code_seen(axis_codes[X_AXIS]))) axis_mask |= (1 << X_AXIS);
+        if((home_all_axis) || (code_seen(axis_codes[Y_AXIS]))) axis_mask |= (1 << Y_AXIS);
+        #if Z_HOME_DIR > 0                    // Z homes away from the bed, so it can go along
+        if((home_all_axis) || (code_seen(axis_codes[Z_AXIS]))) axis_mask |= (1 << Z_AXIS);
+        #endif
+        homeaxes(axis_mask);
+      }
+      #else
+
       #if Z_HOME_DIR > 0                      // If homing away from BED do Z first
       if((home_all_axis) || (code_seen(axis_codes[Z_AXIS]))) {
         HOMEAXIS(Z);
@@ -1554,6 +1700,7 @@ void process_commands()
       if((home_all_axis) || (code_seen(axis_codes[Y_AXIS]))) {
         HOMEAXIS(Y);
       }
+      #endif // PARALLEL_HOMING
 
       if(code_seen(axis_codes[X_AXIS]))
       {
@@ -1644,6 +1791,9 @@ void process_commands()
           current_position[Z_AXIS] += zprobe_zoffset;  //Add Z_Probe offset (the distance is negative)
         }
       #endif
+      #ifdef AUTO_BED_LEVELING_MESH
+        set_mesh_active(mesh_valid);
+      #endif
       plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
 #endif // else DELTA
 
@@ -1686,6 +1836,11 @@ void process_commands()
             //vector_3 corrected_position = plan_get_position_mm();
             //corrected_position.debug("position before G29");
             plan_bed_level_matrix.set_to_identity();
+#ifdef AUTO_BED_LEVELING_MESH
+            // the old mesh is replaced, plan_get_position() returns the machine position from here on
+            mesh_active = false;
+            mesh_valid = false;
+#endif // AUTO_BED_LEVELING_MESH
             vector_3 uncorrected_position = plan_get_position();
             //uncorrected_position.debug("position durring G29");
             current_position[X_AXIS] = uncorrected_position.x;
@@ -1708,34 +1863,34 @@ void process_commands()
             // the normal vector to the plane is formed by the coefficients of the plane equation in the standard form, which is Vx*x+Vy*y+Vz*z+d = 0
             // so Vx = -a Vy = -b Vz = 1 (we want the vector facing towards positive Z
 
-            // "A" matrix of the linear system of equations
-            double eqnAMatrix[AUTO_BED_LEVELING_GRID_POINTS*AUTO_BED_LEVELING_GRID_POINTS*3];
-            // "B" vector of Z points
-            double eqnBVector[AUTO_BED_LEVELING_GRID_POINTS*AUTO_BED_LEVELING_GRID_POINTS];
+#ifndef AUTO_BED_LEVELING_MESH
+            // each probed point adds the row [x y 1] = z to the least squares problem
+            lsq_solver plane_lsq;
+            lsq_init(plane_lsq, 3);
+#endif // !AUTO_BED_LEVELING_MESH
 
 
+            // Walk the grid as a serpentine that starts in the corner nearest to the probe and
+            // runs along the axis with the finer spacing, so the long steps are taken least often.
+            bool rowsAlongX = (xGridSpacing <= yGridSpacing);
+            bool startRight = (current_position[X_AXIS] + X_PROBE_OFFSET_FROM_EXTRUDER) * 2 > LEFT_PROBE_BED_POSITION + RIGHT_PROBE_BED_POSITION;
+            bool startBack = (current_position[Y_AXIS] + Y_PROBE_OFFSET_FROM_EXTRUDER) * 2 > FRONT_PROBE_BED_POSITION + BACK_PROBE_BED_POSITION;
+
             int probePointCounter = 0;
-            bool zig = true;
 
-            for (int yProbe=FRONT_PROBE_BED_POSITION; yProbe <= BACK_PROBE_BED_POSITION; yProbe += yGridSpacing)
+            for (int row = 0; row < AUTO_BED_LEVELING_GRID_POINTS; row++)
             {
-              int xProbe, xInc;
-              if (zig)
-              {
-                xProbe = LEFT_PROBE_BED_POSITION;
-                //xEnd = RIGHT_PROBE_BED_POSITION;
-                xInc = xGridSpacing;
-                zig = false;
-              } else // zag
+              for (int col = 0; col < AUTO_BED_LEVELING_GRID_POINTS; col++)
               {
-                xProbe = RIGHT_PROBE_BED_POSITION;
-                //xEnd = LEFT_PROBE_BED_POSITION;
-                xInc = -xGridSpacing;
-                zig = true;
-              }
+                // every other row is walked backwards
+                int rowPos = (row & 1) ? AUTO_BED_LEVELING_GRID_POINTS - 1 - col : col;
+                int xIndex = rowsAlongX ? rowPos : row;
+                int yIndex = rowsAlongX ? row : rowPos;
+                if (startRight) xIndex = AUTO_BED_LEVELING_GRID_POINTS - 1 - xIndex;
+                if (startBack) yIndex = AUTO_BED_LEVELING_GRID_POINTS - 1 - yIndex;
+                int xProbe = LEFT_PROBE_BED_POSITION + xIndex * xGridSpacing;
+                int yProbe = FRONT_PROBE_BED_POSITION + yIndex * yGridSpacing;
 
-              for (int xCount=0; xCount < AUTO_BED_LEVELING_GRID_POINTS; xCount++)
-              {
                 float z_before;
                 if (probePointCounter == 0)
                 {
@@ -1749,31 +1904,54 @@ void process_commands()
 
                 float measured_z = probe_pt(xProbe, yProbe, z_before);
 
-                eqnBVector[probePointCounter] = measured_z;
-
-                eqnAMatrix[probePointCounter + 0*AUTO_BED_LEVELING_GRID_POINTS*AUTO_BED_LEVELING_GRID_POINTS] = xProbe;
-                eqnAMatrix[probePointCounter + 1*AUTO_BED_LEVELING_GRID_POINTS*AUTO_BED_LEVELING_GRID_POINTS] = yProbe;
-                eqnAMatrix[probePointCounter + 2*AUTO_BED_LEVELING_GRID_POINTS*AUTO_BED_LEVELING_GRID_POINTS] = 1;
+#ifdef AUTO_BED_LEVELING_MESH
+                // store the bed height, i.e. the Z where the nozzle would touch the bed
+                mesh_z_values[yIndex][xIndex] = measured_z - zprobe_zoffset;
+#else
+                double eqnRow[3] = { (double)xProbe, (double)yProbe, 1 };
+                lsq_add_row(plane_lsq, eqnRow, measured_z);
+#endif // AUTO_BED_LEVELING_MESH
                 probePointCounter++;
-                xProbe += xInc;
               }
             }
             clean_up_after_endstop_move();
 
-            // solve lsq problem
-            double *plane_equation_coefficients = qr_solve(AUTO_BED_LEVELING_GRID_POINTS*AUTO_BED_LEVELING_GRID_POINTS, 3, eqnAMatrix, eqnBVector);
-
-            SERIAL_PROTOCOLPGM("Eqn coefficients: a: ");
-            SERIAL_PROTOCOL(plane_equation_coefficients[0]);
-            SERIAL_PROTOCOLPGM(" b: ");
-            SERIAL_PROTOCOL(plane_equation_coefficients[1]);
-            SERIAL_PROTOCOLPGM(" d: ");
-            SERIAL_PROTOCOLLN(plane_equation_coefficients[2]);
-
-
-            set_bed_level_equation_lsq(plane_equation_coefficients);
+#ifdef AUTO_BED_LEVELING_MESH
+            // keep the measured heights instead of fitting a plane through them
+            mesh_valid = true;
+            set_mesh_active(true);
+            plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
 
-            free(plane_equation_coefficients);
+            SERIAL_PROTOCOLLNPGM("Bed height map:");
+            for (int yCount = AUTO_BED_LEVELING_GRID_POINTS - 1; yCount >= 0; yCount--)
+            {
+              for (int xCount = 0; xCount < AUTO_BED_LEVELING_GRID_POINTS; xCount++)
+              {
+                SERIAL_PROTOCOLPGM(" ");
+                SERIAL_PROTOCOL_F(mesh_z_values[yCount][xCount], 3);
+              }
+              SERIAL_PROTOCOLLN("");
+            }
+#else
+            // solve lsq problem
+            double plane_equation_coefficients[3];
+            if (lsq_solve(plane_lsq, plane_equation_coefficients))
+            {
+              SERIAL_PROTOCOLPGM("Eqn coefficients: a: ");
+              SERIAL_PROTOCOL(plane_equation_coefficients[0]);
+              SERIAL_PROTOCOLPGM(" b: ");
+              SERIAL_PROTOCOL(plane_equation_coefficients[1]);
+              SERIAL_PROTOCOLPGM(" d: ");
+              SERIAL_PROTOCOLLN(plane_equation_coefficients[2]);
+
+              set_bed_level_equation_lsq(plane_equation_coefficients);
+            }
+            else
+            {
+              SERIAL_ERROR_START;
+              SERIAL_ERRORLNPGM(MSG_ERR_BED_PLANE_FIT);
+            }
+#endif // AUTO_BED_LEVELING_MESH
 
 #else // AUTO_BED_LEVELING_GRID not defined
 
@@ -1795,6 +1973,7 @@ void process_commands()
 #endif // AUTO_BED_LEVELING_GRID
             st_synchronize();
 
+#ifndef AUTO_BED_LEVELING_MESH
             // The following code correct the Z height difference from z-probe position and hotend tip position.
             // The Z height on homing is measured by Z-Probe, but the probe is quite far from the hotend.
             // When the bed is uneven, this height must be corrected.
@@ -1806,6 +1985,7 @@ void process_commands()
             apply_rotation_xyz(plan_bed_level_matrix, x_tmp, y_tmp, z_tmp);         //Apply the correction sending the probe offset
             current_position[Z_AXIS] = z_tmp - real_z + current_position[Z_AXIS];   //The difference is added to current position and sent to planner.
             plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
+#endif // !AUTO_BED_LEVELING_MESH
 #ifdef Z_PROBE_SLED
             dock_sled(true, -SLED_DOCKING_OFFSET); // correct for over travel.
 #endif // Z_PROBE_SLED
@@ -1821,6 +2001,9 @@ void process_commands()
 
             feedrate = homing_feedrate[Z_AXIS];
 
+            #ifdef AUTO_BED_LEVELING_MESH
+              bool mesh_was_active = mesh_active;
+            #endif
             run_z_probe();
             SERIAL_PROTOCOLPGM(MSG_BED);
             SERIAL_PROTOCOLPGM(" X: ");
@@ -1830,6 +2013,10 @@ void process_commands()
             SERIAL_PROTOCOLPGM(" Z: ");
             SERIAL_PROTOCOL(current_position[Z_AXIS]);
             SERIAL_PROTOCOLPGM("\n");
+            #ifdef AUTO_BED_LEVELING_MESH
+              set_mesh_active(mesh_was_active);
+              plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
+            #endif
 
             clean_up_after_endstop_move();
             retract_z_probe(); // Retract Z Servo endstop if available
@@ -1914,18 +2101,14 @@ void process_commands()
       if (codenum > 0){
         codenum += millis();  // keep track of when we started waiting
         while(millis() < codenum && !lcd_clicked()){
-          manage_heater();
-          manage_inactivity();
-          lcd_update();
+          scheduler_run();
         }
         lcd_ignore_click(false);
       }else{
           if (!lcd_detected())
             break;
         while(!lcd_clicked()){
-          manage_heater();
-          manage_inactivity();
-          lcd_update();
+          scheduler_run();
         }
       }
       if (IS_SD_PRINTING)
@@ -2085,7 +2268,10 @@ void process_commands()
         }
       #if defined(FAN_PIN) && FAN_PIN > -1
         if (pin_number == FAN_PIN)
+        {
           fanSpeed = pin_status;
+          pin_number = -1; // the stepper owns the fan pin, it follows fanSpeed
+        }
       #endif
         if (pin_number > -1)
         {
@@ -2126,6 +2312,9 @@ void process_commands()
 	int verbose_level=1, n=0, j, n_samples = 10, n_legs=0, engage_probe_for_each_reading=0 ;
 	double X_current, Y_current, Z_current;
 	double X_probe_location, Y_probe_location, Z_start_location, ext_position;
+#ifdef AUTO_BED_LEVELING_MESH
+	bool mesh_was_active = mesh_active;
+#endif
 	
 	if (code_seen('V') || code_seen('v')) {
         	verbose_level = code_value();
@@ -2350,6 +2539,13 @@ void process_commands()
 	delay(1000);
 
         clean_up_after_endstop_move();
+#ifdef AUTO_BED_LEVELING_MESH
+	current_position[X_AXIS] = st_get_position_mm(X_AXIS);
+	current_position[Y_AXIS] = st_get_position_mm(Y_AXIS);
+	current_position[Z_AXIS] = st_get_position_mm(Z_AXIS);
+	set_mesh_active(mesh_was_active);
+	plan_set_position(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS]);
+#endif
 
 //      enable_endstops(true);
 
@@ -2524,9 +2720,7 @@ Sigma_Exit:
             #endif
             codenum = millis();
           }
-          manage_heater();
-          manage_inactivity();
-          lcd_update();
+          scheduler_run();
         #ifdef TEMP_RESIDENCY_TIME
             /* start/restart the TEMP_RESIDENCY_TIME timer whenever we reach target temp for the first time
               or when current temp falls outside the hysteresis after target temp was reached */
@@ -2539,10 +2733,82 @@ Sigma_Exit:
         #endif //TEMP_RESIDENCY_TIME
         }
         LCD_MESSAGEPGM(MSG_HEATING_COMPLETE);
+        plan_underrun_ignore(); // the moves ran out while heating
         starttime=millis();
         previous_millis_cmd = millis();
       }
       break;
+    case 116: // M116 - Set the targets and wait for all heaters together
+    {
+      if(setTargetedHotend(116)){
+        break;
+      }
+      LCD_MESSAGEPGM(MSG_HEATING);
+      #ifdef AUTOTEMP
+        autotemp_enabled=false;
+      #endif
+      if (code_seen('S')) {
+        setTargetHotend(code_value(), tmp_extruder);
+#ifdef DUAL_X_CARRIAGE
+        if (dual_x_carriage_mode == DXC_DUPLICATION_MODE && tmp_extruder == 0)
+          setTargetHotend1(code_value() == 0.0 ? 0.0 : code_value() + duplicate_extruder_temp_offset);
+#endif
+      }
+      #if defined(TEMP_BED_PIN) && TEMP_BED_PIN > -1
+        if (code_seen('B')) setTargetBed(code_value());
+      #endif
+      setWatch();
+      codenum = millis();
+
+      cancel_heatup = false;
+
+      #ifdef TEMP_RESIDENCY_TIME
+        long residencyStart;
+        residencyStart = -1;
+      #endif
+      while(!cancel_heatup) {
+        // Only heating is waited for, like M109 S and M190 S
+        bool reached = true;
+        for(int8_t e = 0; e < EXTRUDERS; e++)
+          if(degTargetHotend(e) > 0 && degHotend(e) < degTargetHotend(e) - TEMP_WINDOW) reached = false;
+        #if defined(TEMP_BED_PIN) && TEMP_BED_PIN > -1
+          if(degTargetBed() > 0 && degBed() < degTargetBed() - TEMP_WINDOW) reached = false;
+        #endif
+        #ifdef TEMP_RESIDENCY_TIME
+          if(!reached)
+            residencyStart = -1;
+          else if(residencyStart == -1)
+            residencyStart = millis();
+          else if((millis() - residencyStart) >= (TEMP_RESIDENCY_TIME * 1000UL))
+            break;
+        #else
+          if(reached)
+            break;
+        #endif
+
+        if(( millis() - codenum) > 1000 ) //Print Temp Reading every 1 second while heating up.
+        {
+          for(int8_t e = 0; e < EXTRUDERS; e++) {
+            SERIAL_PROTOCOLPGM(" T");
+            SERIAL_PROTOCOL((int)e);
+            SERIAL_PROTOCOLPGM(":");
+            SERIAL_PROTOCOL_F(degHotend(e),1);
+          }
+          #if defined(TEMP_BED_PIN) && TEMP_BED_PIN > -1
+            SERIAL_PROTOCOLPGM(" B:");
+            SERIAL_PROTOCOL_F(degBed(),1);
+          #endif
+          SERIAL_PROTOCOLLN("");
+          codenum = millis();
+        }
+        scheduler_run();
+      }
+      LCD_MESSAGEPGM(MSG_HEATING_COMPLETE);
+      plan_underrun_ignore(); // the moves ran out while heating
+      starttime=millis();
+      previous_millis_cmd = millis();
+    }
+    break;
     case 190: // M190 - Wait for bed heater to reach target.
     #if defined(TEMP_BED_PIN) && TEMP_BED_PIN > -1
         LCD_MESSAGEPGM(MSG_BED_HEATING);
@@ -2572,11 +2838,10 @@ Sigma_Exit:
             SERIAL_PROTOCOLLN("");
             codenum = millis();
           }
-          manage_heater();
-          manage_inactivity();
-          lcd_update();
+          scheduler_run();
         }
         LCD_MESSAGEPGM(MSG_BED_DONE);
+        plan_underrun_ignore();
         previous_millis_cmd = millis();
     #endif
         break;
@@ -2814,6 +3079,7 @@ Sigma_Exit:
         SERIAL_PROTOCOLPGM(MSG_Z_MAX);
         SERIAL_PROTOCOLLN(((READ(Z_MAX_PIN)^Z_MAX_ENDSTOP_INVERTING)?MSG_ENDSTOP_HIT:MSG_ENDSTOP_OPEN));
       #endif
+      report_endstop_triggers();
       break;
       //TODO: update for all axis, use for loop
     #ifdef BLINKM
@@ -3013,6 +3279,20 @@ Sigma_Exit:
 
     }break;
     #endif // FWRETRACT
+    #ifdef VOLUMETRIC_FLOW_LIMIT
+    case 213: // M213 T<extruder> S<mm^3/s> - set the maximum volumetric flow
+    {
+      if(setTargetedHotend(213)){
+        break;
+      }
+      if(code_seen('S'))
+        max_volumetric_flow[tmp_extruder] = max(code_value(), 0);
+      SERIAL_ECHO_START;
+      SERIAL_ECHOPAIR(MSG_MAX_VOLUMETRIC_FLOW, max_volumetric_flow[tmp_extruder]);
+      SERIAL_ECHOLN("");
+    }
+    break;
+    #endif
     #if EXTRUDERS > 1
     case 218: // M218 - set hotend offset (in mm), T<extruder_number> X<offset_on_X> Y<offset_on_Y>
     {
@@ -3119,10 +3399,9 @@ Sigma_Exit:
             }
 
             while(digitalRead(pin_number) != target){
-              manage_heater();
-              manage_inactivity();
-              lcd_update();
+              scheduler_run();
             }
+            plan_underrun_ignore();
           }
         }
       }
@@ -3281,6 +3560,64 @@ Sigma_Exit:
           SERIAL_PROTOCOLLN("");
      }
     break;
+#endif
+#ifdef LCD_RENDER_STATS
+    case 251: // M251 - Print the LCD render statistics, R resets them
+    {
+      if (code_seen('R'))
+        lcd_render_stats_reset();
+      else
+        lcd_render_stats_report();
+    }
+    break;
+#endif
+    case 252: // M252 - Print the main loop task times, R resets them, T<task> S<ms> sets a task period
+    {
+      if (code_seen('R'))
+        scheduler_reset_stats();
+      else if (code_seen('T'))
+      {
+        unsigned char task = code_value();
+        if (code_seen('S'))
+        {
+          long period = code_value_long();
+          if (period < 0 || period > 65535)
+          {
+            SERIAL_ECHO_START;
+            SERIAL_ECHOPGM(MSG_M252_INVALID_PERIOD);
+            SERIAL_ECHOLN(period);
+          }
+          else if (!scheduler_set_period(task, period))
+          {
+            SERIAL_ECHO_START;
+            SERIAL_ECHOPGM(MSG_M252_INVALID_TASK);
+            SERIAL_ECHOLN((int)task);
+          }
+        }
+      }
+      else
+        scheduler_report();
+    }
+    break;
+#ifdef CPU_PROFILING
+    case 253: // M253 - Print the interrupt and main loop times, R resets them
+    {
+      if (code_seen('R'))
+        profile_reset();
+      else
+        profile_report();
+    }
+    break;
+#endif
+#ifdef PLANNER_UNDERRUN_STATS
+    case 254: // M254 - Print the planner underrun statistics, R resets them
+    {
+      if (code_seen('R'))
+        plan_underrun_reset();
+      else
+        plan_underrun_report();
+    }
+    break;
 #endif
     #ifdef PREVENT_DANGEROUS_EXTRUDE
     case 302: // allow cold extrudes, or set the minimum extrude temperature
@@ -3294,16 +3631,43 @@ Sigma_Exit:
     case 303: // M303 PID autotune
     {
       float temp = 150.0;
+      float bed_temp = 70.0;
       int e=0;
       int c=5;
+      uint8_t heaters;
+      uint8_t rule = PID_TUNE_ZIEGLER_NICHOLS;
       if (code_seen('E')) e=code_value();
         if (e<0)
           temp=70;
       if (code_seen('S')) temp=code_value();
       if (code_seen('C')) c=code_value();
-      PID_autotune(temp, e, c);
+      if (code_seen('R')) rule=code_value();
+      if (code_seen('A')) {
+        heaters = (1 << EXTRUDERS) - 1; // all hotends, the bed too if it has a temperature
+        if (code_seen('B')) {
+          heaters |= 1 << EXTRUDERS;
+          bed_temp = code_value();
+        }
+      }
+      else if (e < 0) {
+        heaters = 1 << EXTRUDERS;
+        bed_temp = temp;
+      }
+      else
+        heaters = (e < EXTRUDERS) ? (1 << e) : 0;
+      PID_autotune(temp, bed_temp, heaters, c, rule, code_seen('U'));
     }
     break;
+    #ifdef HEATER_EVENT_LOG
+    case 305: // M305 - Print or store the heater log
+    {
+      if (code_seen('R'))
+        heater_log_clear();
+      else
+        heater_log_dump(code_seen('S') && code_value() == 1);
+    }
+    break;
+    #endif
 	#ifdef SCARA
 	case 360:  // M360 SCARA Theta pos1
       SERIAL_ECHOLN(" Cal: Theta 0 ");
@@ -3439,23 +3803,10 @@ case 404:  //M404 Enter the nominal filament width (3mm, 1.75mm ) N<3.0> or disp
     {
     
     
-    if(code_seen('D')) meas_delay_cm=code_value();
-       
-       if(meas_delay_cm> MAX_MEASUREMENT_DELAY)
-       	meas_delay_cm = MAX_MEASUREMENT_DELAY;
-    
-       if(delay_index2 == -1)  //initialize the ring buffer if it has not been done since startup
-    	   {
-    	   int temp_ratio = widthFil_to_size_ratio(); 
-       	    
-       	    for (delay_index1=0; delay_index1<(MAX_MEASUREMENT_DELAY+1); ++delay_index1 ){
-       	              measurement_delay[delay_index1]=temp_ratio-100;  //subtract 100 to scale within a signed byte
-       	        }
-       	    delay_index1=0;
-       	    delay_index2=0;	
-    	   }
+    if(code_seen('D')) meas_delay_cm=constrain(code_value(), 0, MAX_MEASUREMENT_DELAY);
     
     filament_sensor = true ; 
+    filwidth_update_multiplier();
     
     //SERIAL_PROTOCOLPGM("Filament dia (measured mm):"); 
     //SERIAL_PROTOCOL(filament_width_meas); 
@@ -3467,6 +3818,7 @@ case 404:  //M404 Enter the nominal filament width (3mm, 1.75mm ) N<3.0> or disp
     case 406:  //M406 Turn off filament sensor for control 
     {      
     filament_sensor = false ; 
+    calculate_volumetric_multipliers();
     } 
     break; 
   
@@ -3636,9 +3988,7 @@ case 404:  //M404 Enter the nominal filament width (3mm, 1.75mm ) N<3.0> or disp
         uint8_t cnt=0;
         while(!lcd_clicked()){
           cnt++;
-          manage_heater();
-          manage_inactivity(true);
-          lcd_update();
+          scheduler_run(false, true);
           if(cnt==0)
           {
           #if BEEPER > 0
@@ -4033,6 +4383,41 @@ void calculate_delta(float cartesian[3])
 }
 #endif
 
+#ifdef AUTO_BED_LEVELING_MESH
+// Queue the move from current_position to destination, split where it crosses
+// a mesh grid line so that every segment gets the Z correction of its own cell.
+static void mesh_plan_buffer_line(float feed_rate)
+{
+  float difference[NUM_AXIS];
+  for (int8_t i=0; i < NUM_AXIS; i++) {
+    difference[i] = destination[i] - current_position[i];
+  }
+  float fraction = 0;
+  for (;;) {
+    // look for the nearest grid line ahead of the last split point
+    float next_fraction = 1;
+    for (int8_t i = 1; i < AUTO_BED_LEVELING_GRID_POINTS - 1; i++) {
+      if (difference[X_AXIS] != 0) {
+        float f = (LEFT_PROBE_BED_POSITION + i * MESH_X_DIST - current_position[X_AXIS]) / difference[X_AXIS];
+        if (f > fraction && f < next_fraction) next_fraction = f;
+      }
+      if (difference[Y_AXIS] != 0) {
+        float f = (FRONT_PROBE_BED_POSITION + i * MESH_Y_DIST - current_position[Y_AXIS]) / difference[Y_AXIS];
+        if (f > fraction && f < next_fraction) next_fraction = f;
+      }
+    }
+    if (next_fraction >= 1) break;
+    fraction = next_fraction;
+    plan_buffer_line(current_position[X_AXIS] + difference[X_AXIS] * fraction,
+                     current_position[Y_AXIS] + difference[Y_AXIS] * fraction,
+                     current_position[Z_AXIS] + difference[Z_AXIS] * fraction,
+                     current_position[E_AXIS] + difference[E_AXIS] * fraction,
+                     feed_rate, active_extruder);
+  }
+  plan_buffer_line(destination[X_AXIS], destination[Y_AXIS], destination[Z_AXIS], destination[E_AXIS], feed_rate, active_extruder);
+}
+#endif // AUTO_BED_LEVELING_MESH
+
 void prepare_move()
 {
   clamp_to_software_endstops(destination);
@@ -4151,7 +4536,11 @@ for (int s = 1; s <= steps; s++) {
       plan_buffer_line(destination[X_AXIS], destination[Y_AXIS], destination[Z_AXIS], destination[E_AXIS], feedrate/60, active_extruder);
   }
   else {
+  #ifdef AUTO_BED_LEVELING_MESH
+    mesh_plan_buffer_line(feedrate*feedmultiply/60/100.0);
+  #else
     plan_buffer_line(destination[X_AXIS], destination[Y_AXIS], destination[Z_AXIS], destination[E_AXIS], feedrate*feedmultiply/60/100.0, active_extruder);
+  #endif
   }
 #endif // !(DELTA || SCARA)
 
@@ -4501,6 +4890,41 @@ void Stop()
 
 bool IsStopped() { return Stopped; };
 
+// The compare register behind a pin whose timer stays in the 8 bit phase correct PWM the Arduino init sets up,
+// NULL if the timer is taken. Timer 0 runs millis() and the temperature ISR, timer 1 the steppers, tone() for
+// the beeper takes timer 2 and the servos the 16 bit timers.
+volatile uint8_t *pwm_output_register(int8_t pin, bool &wide)
+{
+  wide = false;
+  if (pin < 0) return NULL;
+  switch (digitalPinToTimer(pin)) {
+    #if defined(OCR2A) && !(defined(BEEPER) && BEEPER > 0)
+    case TIMER2A: return &OCR2A;
+    case TIMER2B: return &OCR2B;
+    #endif
+    #if NUM_SERVOS == 0
+      #ifdef OCR3AL
+      case TIMER3A: wide = true; return (volatile uint8_t *)&OCR3A;
+      case TIMER3B: wide = true; return (volatile uint8_t *)&OCR3B;
+      #endif
+      #ifdef OCR3CL
+      case TIMER3C: wide = true; return (volatile uint8_t *)&OCR3C;
+      #endif
+      #ifdef OCR4AL
+      case TIMER4A: wide = true; return (volatile uint8_t *)&OCR4A;
+      case TIMER4B: wide = true; return (volatile uint8_t *)&OCR4B;
+      case TIMER4C: wide = true; return (volatile uint8_t *)&OCR4C;
+      #endif
+      #ifdef OCR5AL
+      case TIMER5A: wide = true; return (volatile uint8_t *)&OCR5A;
+      case TIMER5B: wide = true; return (volatile uint8_t *)&OCR5B;
+      case TIMER5C: wide = true; return (volatile uint8_t *)&OCR5C;
+      #endif
+    #endif
+  }
+  return NULL;
+}
+
 #ifdef FAST_PWM_FAN
 void setPwmFrequency(uint8_t pin, int val)
 {
@@ -4587,6 +5011,12 @@ bool setTargetedHotend(int code){
         case 109:
           SERIAL_ECHO(MSG_M109_INVALID_EXTRUDER);
           break;
+        case 116:
+          SERIAL_ECHO(MSG_M116_INVALID_EXTRUDER);
+          break;
+        case 213:
+          SERIAL_ECHO(MSG_M213_INVALID_EXTRUDER);
+          break;
         case 218:
           SERIAL_ECHO(MSG_M218_INVALID_EXTRUDER);
           break;
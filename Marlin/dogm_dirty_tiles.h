@@ -0,0 +1,75 @@
+#ifndef DOGM_DIRTY_TILES_H
+#define DOGM_DIRTY_TILES_H
+
+/**
+ * Dirty tile tracking for the 128x64 graphic displays.
+ *
+ * u8glib draws the screen one page strip at a time and sends every strip. Each strip is split
+ * into tiles of 16x8 pixels here, and a CRC of every tile as it was last sent is kept
+ * (128 bytes of RAM). The display drivers only send the tiles whose CRC changed. In case two
+ * contents still give the same CRC, the status screen resends one band every second.
+ */
+
+#include "Marlin.h"
+#include <util/crc16.h>
+
+#ifdef DOGLCD_DIRTY_TILES
+
+#define DOG_TILE_WIDTH  16
+#define DOG_TILE_HEIGHT 8
+#define DOG_TILES_X     (128 / DOG_TILE_WIDTH)
+#define DOG_TILES_Y     (64 / DOG_TILE_HEIGHT)
+
+static uint16_t dog_tile_sum[DOG_TILES_Y][DOG_TILES_X];
+static uint8_t dog_stale_bands = 0xFF; // bands that have to be sent in full, the display content is unknown
+static uint8_t dog_refresh_band = 0;
+static unsigned long dog_refresh_millis = 0;
+
+// Send the whole screen with the next update
+static void dog_tiles_invalidate() { dog_stale_bands = 0xFF; }
+
+// Send one more band in full every second, in turn
+static void dog_tiles_refresh()
+{
+  if (millis() - dog_refresh_millis < 1000) return;
+  dog_refresh_millis = millis();
+  dog_stale_bands |= 1 << dog_refresh_band;
+  dog_refresh_band = (dog_refresh_band + 1) % DOG_TILES_Y;
+}
+
+// Compare the tiles of one 8 pixel band with what was sent before. p points at the first tile,
+// a tile is rows runs of run bytes, stride apart, and the next tile starts tile_step bytes further.
+// Returns one bit per changed tile.
+static uint8_t dog_tiles_changed(uint8_t band, const uint8_t *p, uint8_t tile_step, uint8_t run, uint8_t rows, uint8_t stride)
+{
+  uint8_t changed = 0;
+  bool stale = dog_stale_bands & (1 << band);
+  for (uint8_t t = 0; t < DOG_TILES_X; t++, p += tile_step)
+  {
+    // CRC-CCITT, unlike a byte sum it also sees bytes that moved within the tile
+    uint16_t sum = 0xFFFF;
+    const uint8_t *q = p;
+    for (uint8_t r = 0; r < rows; r++, q += stride)
+      for (uint8_t i = 0; i < run; i++)
+        sum = _crc_ccitt_update(sum, q[i]);
+    if (stale || sum != dog_tile_sum[band][t])
+    {
+      dog_tile_sum[band][t] = sum;
+      changed |= 1 << t;
+    }
+  }
+  dog_stale_bands &= ~(1 << band);
+  return changed;
+}
+
+// First and last set bit of a tile mask, the tiles in between are sent as one run
+static void dog_tiles_span(uint8_t changed, uint8_t &first, uint8_t &last)
+{
+  first = 0;
+  while (!(changed & (1 << first))) first++;
+  last = DOG_TILES_X - 1;
+  while (!(changed & (1 << last))) last--;
+}
+
+#endif //DOGLCD_DIRTY_TILES
+#endif //DOGM_DIRTY_TILES_H
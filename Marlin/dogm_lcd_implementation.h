@@ -38,6 +38,7 @@
 #include "dogm_font_data_marlin.h"
 #include "ultralcd.h"
 #include "ultralcd_st7920_u8glib_rrd.h"
+#include "dogm_dirty_tiles.h"
 
 /* Russian language not supported yet, needs custom font
 
@@ -85,8 +86,65 @@ U8GLIB_NHD_C12864 u8g(DOGLCD_CS, DOGLCD_A0);
 U8GLIB_DOGM128 u8g(DOGLCD_CS, DOGLCD_A0);	// HW-SPI Com: CS, A0
 #endif
 
+#if (defined(DOGLCD_DIRTY_TILES) || defined(LCD_RENDER_STATS)) && !defined(U8GLIB_ST7920)
+// The ST7565 displays take one page (8 pixel band) at a time from a start column. The device of
+// u8glib is wrapped to send only the columns from the first to the last changed tile of a page,
+// and to count the bytes sent.
+#ifdef MAKRPANEL
+  #define DOG_COLUMN_OFFSET 4 // the NHD C12864 starts at column 4
+#else
+  #define DOG_COLUMN_OFFSET 0
+#endif
+
+static u8g_dev_t dog_tiles_dev;
+static u8g_dev_fnptr dog_tiles_base_fn;
+
+static uint8_t dog_tiles_dev_fn(u8g_t *u8g, u8g_dev_t *dev, uint8_t msg, void *arg)
+{
+  if (msg != U8G_DEV_MSG_PAGE_NEXT)
+    return dog_tiles_base_fn(u8g, dev, msg, arg);
+
+  u8g_pb_t *pb = (u8g_pb_t *)(dev->dev_mem);
+#ifndef DOGLCD_DIRTY_TILES
+  LCD_STATS_BYTES(3 + pb->width); // page, column and the data
+  return dog_tiles_base_fn(u8g, dev, msg, arg);
+#else
+  uint8_t changed = dog_tiles_changed(pb->p.page, (uint8_t *)pb->buf, DOG_TILE_WIDTH, DOG_TILE_WIDTH, 1, 0);
+  if (changed) {
+    uint8_t first, last;
+    dog_tiles_span(changed, first, last);
+    uint8_t column = first * DOG_TILE_WIDTH + DOG_COLUMN_OFFSET;
+    u8g_SetChipSelect(u8g, dev, 1);
+    u8g_SetAddress(u8g, dev, 0);                // instruction mode
+    u8g_WriteByte(u8g, dev, 0x10 | (column >> 4));
+    u8g_WriteByte(u8g, dev, column & 0x0F);
+    u8g_WriteByte(u8g, dev, 0xB0 | pb->p.page);
+    u8g_SetAddress(u8g, dev, 1);                // data mode
+    u8g_WriteSequence(u8g, dev, (last - first + 1) * DOG_TILE_WIDTH, (uint8_t *)pb->buf + first * DOG_TILE_WIDTH);
+    u8g_SetChipSelect(u8g, dev, 0);
+    LCD_STATS_BYTES(3 + (last - first + 1) * DOG_TILE_WIDTH);
+  }
+  return u8g_dev_pb8v1_base_fn(u8g, dev, msg, arg); // next page
+#endif
+}
+#endif
+
 static void lcd_implementation_init()
 {
+#if (defined(DOGLCD_DIRTY_TILES) || defined(LCD_RENDER_STATS)) && !defined(U8GLIB_ST7920)
+	if (dog_tiles_base_fn == NULL) {
+		// Before the rotation, which puts its own device in front
+		u8g_t *g = u8g.getU8g();
+		dog_tiles_dev = *g->dev;
+		dog_tiles_base_fn = g->dev->dev_fn;
+		dog_tiles_dev.dev_fn = dog_tiles_dev_fn;
+		g->dev = &dog_tiles_dev;
+	}
+#endif
+#ifdef DOGLCD_DIRTY_TILES
+	dog_tiles_invalidate();
+#endif
+
 #ifdef LCD_PIN_BL
 	pinMode(LCD_PIN_BL, OUTPUT);	// Enable LCD backlight
 	digitalWrite(LCD_PIN_BL, HIGH);
@@ -142,6 +200,10 @@ static void lcd_implementation_init()
 
 static void lcd_implementation_clear()
 {
+#ifdef DOGLCD_DIRTY_TILES
+	// Called when a new screen is drawn. Send it in full once, a stale tile can not outlive a menu change.
+	dog_tiles_invalidate();
+#endif
 // NO NEED TO IMPLEMENT LIKE SO. Picture loop automatically clears the display.
 //
 // Check this article: http://arduino.cc/forum/index.php?topic=91395.25;wap2
@@ -186,6 +248,9 @@ static void _draw_heater_status(int x, int heater) {
 
 static void lcd_implementation_status_screen()
 {
+#ifdef DOGLCD_DIRTY_TILES
+ dog_tiles_refresh();
+#endif
 
  static unsigned char fan_rot = 0;
  
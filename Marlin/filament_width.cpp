@@ -0,0 +1,80 @@
+#include "Marlin.h"
+#include "filament_width.h"
+
+#ifdef FILAMENT_SENSOR
+
+#define FILWIDTH_SAMPLES ((int)(MAX_MEASUREMENT_DELAY * 10 / FILWIDTH_SAMPLE_MM) + 2)
+#define FILWIDTH_STEPS_PER_MM 100   // filament positions are kept in 1/100 mm
+#define FILWIDTH_MULT_SCALE 10000   // and the multipliers in 1/10000
+
+static long filwidth_pos = 0;                      // filament moved by the planner so far
+static long sample_pos[FILWIDTH_SAMPLES];          // filament position of each reading, ascending
+static unsigned int sample_mult[FILWIDTH_SAMPLES]; // multiplier of each reading
+static unsigned char sample_head = 0;              // index of the newest reading
+static unsigned char sample_count = 0;
+static unsigned char sample_cursor = 0;            // age (0 = newest) of the reading found by the last lookup
+
+static FORCE_INLINE unsigned char sample_index(unsigned char age)
+{
+  return (sample_head + FILWIDTH_SAMPLES - age) % FILWIDTH_SAMPLES;
+}
+
+// Cross section of the nominal filament over the measured one
+static float filwidth_area_ratio()
+{
+  float width = filament_width_meas;
+  if (width < MEASURED_LOWER_LIMIT)
+    width = filament_width_nominal; // assume the sensor cut out
+  else if (width > MEASURED_UPPER_LIMIT)
+    width = MEASURED_UPPER_LIMIT;
+  return square(filament_width_nominal / width);
+}
+
+void filwidth_planned_move(float e_mm)
+{
+  filwidth_pos += lround(e_mm * FILWIDTH_STEPS_PER_MM);
+
+  // Retracts move back along the stored readings, only new filament gets a new reading
+  if (sample_count == 0 || filwidth_pos - sample_pos[sample_head] >= (long)(FILWIDTH_SAMPLE_MM * FILWIDTH_STEPS_PER_MM))
+  {
+    if (sample_count > 0)
+    {
+      sample_head = (sample_head + 1) % FILWIDTH_SAMPLES;
+      sample_cursor++;
+    }
+    if (sample_count < FILWIDTH_SAMPLES) sample_count++;
+    if (sample_cursor >= sample_count) sample_cursor = sample_count - 1;
+    sample_pos[sample_head] = filwidth_pos;
+    sample_mult[sample_head] = filwidth_area_ratio() * FILWIDTH_MULT_SCALE;
+  }
+
+  if (filament_sensor) filwidth_update_multiplier();
+}
+
+void filwidth_update_multiplier()
+{
+  float mult = filwidth_area_ratio(); // nothing stored yet, the reading at hand is all there is
+  if (sample_count > 0)
+  {
+    // The filament at the melt zone passed the sensor meas_delay_cm ago. The lookups move along
+    // with the filament, so the cursor only has to step over a reading now and then.
+    long pos = filwidth_pos - lround(meas_delay_cm * 10 * FILWIDTH_STEPS_PER_MM);
+    unsigned char age = sample_cursor;
+    while (age > 0 && sample_pos[sample_index(age - 1)] <= pos) age--;
+    while (age < sample_count - 1 && sample_pos[sample_index(age)] > pos) age++;
+    sample_cursor = age;
+
+    unsigned char i = sample_index(age);
+    mult = sample_mult[i];
+    if (age > 0 && sample_pos[i] <= pos)
+    {
+      // Between two readings, interpolate. Before the oldest or after the newest one, hold it.
+      unsigned char j = sample_index(age - 1);
+      mult += ((float)sample_mult[j] - sample_mult[i]) * (pos - sample_pos[i]) / (sample_pos[j] - sample_pos[i]);
+    }
+    mult /= FILWIDTH_MULT_SCALE;
+  }
+  volumetric_multiplier[FILAMENT_SENSOR_EXTRUDER_NUM] = max(mult, 0.01);
+}
+
+#endif //FILAMENT_SENSOR
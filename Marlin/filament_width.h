@@ -0,0 +1,23 @@
+#ifndef FILAMENT_WIDTH_H
+#define FILAMENT_WIDTH_H
+
+#include "Marlin.h"
+
+#ifdef FILAMENT_SENSOR
+
+// Delay line between the filament width sensor and the melt zone.
+// The readings are stored with the filament position (in mm of filament moved by the
+// FILAMENT_SENSOR_EXTRUDER_NUM extruder) at which they were taken. The multiplier for a
+// move is interpolated between the two readings taken meas_delay_cm earlier.
+
+// The planner moved the filament by e_mm (negative for retracts). Stores a new reading if the
+// filament advanced far enough and, with the sensor control on, puts the multiplier for the
+// filament that reaches the melt zone with the next move into volumetric_multiplier.
+void filwidth_planned_move(float e_mm);
+
+// Set volumetric_multiplier for the current filament position, used when M405 turns the control on
+void filwidth_update_multiplier();
+
+#endif //FILAMENT_SENSOR
+
+#endif
@@ -118,10 +118,15 @@
 #define MSG_M104_INVALID_EXTRUDER           "M104 Invalid extruder "
 #define MSG_M105_INVALID_EXTRUDER           "M105 Invalid extruder "
 #define MSG_M200_INVALID_EXTRUDER           "M200 Invalid extruder "
+#define MSG_M213_INVALID_EXTRUDER           "M213 Invalid extruder "
 #define MSG_M218_INVALID_EXTRUDER           "M218 Invalid extruder "
 #define MSG_M221_INVALID_EXTRUDER           "M221 Invalid extruder "
+#define MSG_M252_INVALID_TASK               "M252 Invalid or fixed task "
+#define MSG_M252_INVALID_PERIOD             "M252 Invalid period "
+#define MSG_MAX_VOLUMETRIC_FLOW             "Maximum volumetric flow (mm3/s): "
 #define MSG_ERR_NO_THERMISTORS              "No thermistors - no temperature"
 #define MSG_M109_INVALID_EXTRUDER           "M109 Invalid extruder "
+#define MSG_M116_INVALID_EXTRUDER           "M116 Invalid extruder "
 #define MSG_HEATING                         "Heating..."
 #define MSG_HEATING_COMPLETE                "Heating done."
 #define MSG_BED_HEATING                     "Bed Heating."
@@ -143,7 +148,19 @@
 #define MSG_M119_REPORT                     "Reporting endstop status"
 #define MSG_ENDSTOP_HIT                     "TRIGGERED"
 #define MSG_ENDSTOP_OPEN                    "open"
+#define MSG_ENDSTOP_TRIGGER_POS             "last trigger:"
+#define MSG_ENDSTOP_POLLED                  "No interrupt for endstop pin, polling it: "
 #define MSG_HOTEND_OFFSET                   "Hotend offsets:"
+#define MSG_THERMAL_SIMULATION              "Thermal simulation, temperatures are not measured!"
+#define MSG_HEATER_LOG_SD_BUSY              "Heater log not written, no SD card or a file is open"
+#define MSG_HEATER_LOG_FAULT                "Heater fault, heater log:"
+#define MSG_ERR_BED_PLANE_FIT               "Cannot fit a plane through the probed points, leveling not applied"
+#define MSG_ERR_EEPROM_CORRUPT              "EEPROM settings corrupt, using the defaults"
+#define MSG_ERR_EEPROM_SLOT_TOO_SMALL       "Settings not stored, they do not fit in an EEPROM slot. Lower EEPROM_SLOTS"
+#define MSG_TMC26X_TEMPERATURE_WARNING      "driver temperature warning"
+#define MSG_TMC26X_OVER_TEMPERATURE         "driver over temperature shutdown"
+#define MSG_TMC26X_SHORT                    "motor short to ground"
+#define MSG_TMC26X_OPEN_LOAD                "motor coil open"
 
 #define MSG_SD_CANT_OPEN_SUBDIR             "Cannot open subdir"
 #define MSG_SD_INIT_FAIL                    "SD init fail"
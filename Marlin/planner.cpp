@@ -56,7 +56,12 @@
 #include "stepper.h"
 #include "temperature.h"
 #include "ultralcd.h"
+#include "scheduler.h"
 #include "language.h"
+#include "filament_width.h"
+#if defined(PLANNER_UNDERRUN_STATS) && defined(SDSUPPORT)
+  #include "cardreader.h"
+#endif
 
 //===========================================================================
 //=============================public variables ============================
@@ -74,6 +79,9 @@ float max_z_jerk;
 float max_e_jerk;
 float mintravelfeedrate;
 unsigned long axis_steps_per_sqr_second[NUM_AXIS];
+#ifdef VOLUMETRIC_FLOW_LIMIT
+float max_volumetric_flow[EXTRUDERS]; // mm^3/s, 0 for no limit
+#endif
 
 #ifdef ENABLE_AUTO_BED_LEVELING
 // this holds the required transform to compensate for bed level
@@ -84,8 +92,17 @@ matrix_3x3 plan_bed_level_matrix = {
 };
 #endif // #ifdef ENABLE_AUTO_BED_LEVELING
 
+#ifdef AUTO_BED_LEVELING_MESH
+float mesh_z_values[AUTO_BED_LEVELING_GRID_POINTS][AUTO_BED_LEVELING_GRID_POINTS];
+bool mesh_valid = false;
+bool mesh_active = false;
+#endif // AUTO_BED_LEVELING_MESH
+
 // The current position of the tool in absolute steps
 long position[NUM_AXIS];   //rescaled from extern when axis_steps_per_unit are changed by gcode
+static float position_steps_per_unit[NUM_AXIS]; // the axis_steps_per_unit position[] is in
+static unsigned char steps_version = 0;         // version of position_steps_per_unit
+float steps_rescale[STEPS_VERSIONS][NUM_AXIS];
 static float previous_speed[NUM_AXIS]; // Speed of previous path line segment
 static float previous_nominal_speed; // Nominal speed of previous path line segment
 
@@ -104,6 +121,11 @@ unsigned char g_uc_extruder_last_move[3] = {0,0,0};
 block_t block_buffer[BLOCK_BUFFER_SIZE];            // A ring buffer for motion instfructions
 volatile unsigned char block_buffer_head;           // Index of the next block to be pushed
 volatile unsigned char block_buffer_tail;           // Index of the block to process now
+volatile unsigned char axis_blocks[NUM_AXIS];       // Queued blocks moving each axis, kept by plan_buffer_line and plan_discard_current_block
+#ifdef PLANNER_UNDERRUN_STATS
+volatile unsigned long planner_empty_since = 0;
+volatile unsigned long planner_low_since = 0;
+#endif
 
 //===========================================================================
 //=============================private variables ============================
@@ -119,10 +141,6 @@ static long x_segment_time[3]={MAX_FREQ_TIME + 1,0,0};     // Segment times (in
 static long y_segment_time[3]={MAX_FREQ_TIME + 1,0,0};
 #endif
 
-#ifdef FILAMENT_SENSOR
- static char meas_sample; //temporary variable to hold filament measurement sample
-#endif
-
 // Returns the index of the next block in the ring buffer
 // NOTE: Removed modulo (%) operator, which uses an expensive divide and multiplication.
 static int8_t next_block_index(int8_t block_index) {
@@ -393,7 +411,9 @@ void planner_recalculate() {
 void plan_init() {
   block_buffer_head = 0;
   block_buffer_tail = 0;
+  memset((void *)axis_blocks, 0, sizeof(axis_blocks));
   memset(position, 0, sizeof(position)); // clear position
+  memcpy(position_steps_per_unit, axis_steps_per_unit, sizeof(position_steps_per_unit));
   previous_speed[0] = 0.0;
   previous_speed[1] = 0.0;
   previous_speed[2] = 0.0;
@@ -447,84 +467,179 @@ void getHighESpeed()
 }
 #endif
 
-void check_axes_activity()
+#ifdef PID_ADD_EXTRUSION_RATE
+float plan_extrusion_rate(uint8_t extruder)
 {
-  unsigned char x_active = 0;
-  unsigned char y_active = 0;  
-  unsigned char z_active = 0;
-  unsigned char e_active = 0;
-  unsigned char tail_fan_speed = fanSpeed;
-  #ifdef BARICUDA
-  unsigned char tail_valve_pressure = ValvePressure;
-  unsigned char tail_e_to_p_pressure = EtoPPressure;
-  #endif
-  block_t *block;
+  float e_steps = 0, seconds = 0;
+  uint8_t block_index = block_buffer_tail;
 
-  if(block_buffer_tail != block_buffer_head)
-  {
-    uint8_t block_index = block_buffer_tail;
-    tail_fan_speed = block_buffer[block_index].fan_speed;
-    #ifdef BARICUDA
-    tail_valve_pressure = block_buffer[block_index].valve_pressure;
-    tail_e_to_p_pressure = block_buffer[block_index].e_to_p_pressure;
-    #endif
-    while(block_index != block_buffer_head)
-    {
-      block = &block_buffer[block_index];
-      if(block->steps_x != 0) x_active++;
-      if(block->steps_y != 0) y_active++;
-      if(block->steps_z != 0) z_active++;
-      if(block->steps_e != 0) e_active++;
-      block_index = (block_index+1) & (BLOCK_BUFFER_SIZE - 1);
+  // Only printing moves count, retracts and their recovery would just cancel out
+  while(block_index != block_buffer_head) {
+    block_t *block = &block_buffer[block_index];
+    if(block->active_extruder == extruder && block->steps_e > 0 &&
+      (block->direction_bits & (1<<E_AXIS)) == 0 &&
+      (block->steps_x != 0 || block->steps_y != 0) && block->nominal_speed > 0) {
+      e_steps += block->steps_e;
+      seconds += block->millimeters / block->nominal_speed;
     }
+    block_index = next_block_index(block_index);
   }
-  if((DISABLE_X) && (x_active == 0)) disable_x();
-  if((DISABLE_Y) && (y_active == 0)) disable_y();
-  if((DISABLE_Z) && (z_active == 0)) disable_z();
-  if((DISABLE_E) && (e_active == 0))
+  if(seconds == 0) return 0;
+
+  // E is in mm of filament here, without M200 the filament has the nominal diameter
+  float diameter = (volumetric_enabled && filament_size[extruder] > 0) ? filament_size[extruder] : DEFAULT_NOMINAL_FILAMENT_DIA;
+  return e_steps / axis_steps_per_unit[E_AXIS] / seconds * (M_PI / 4.0) * square(diameter);
+}
+#endif
+
+void check_axes_activity()
+{
+  if((DISABLE_X) && (axis_blocks[X_AXIS] == 0)) disable_x();
+  if((DISABLE_Y) && (axis_blocks[Y_AXIS] == 0)) disable_y();
+  if((DISABLE_Z) && (axis_blocks[Z_AXIS] == 0)) disable_z();
+  if((DISABLE_E) && (axis_blocks[E_AXIS] == 0))
   {
     disable_e0();
     disable_e1();
     disable_e2(); 
   }
-#if defined(FAN_PIN) && FAN_PIN > -1
-  #ifdef FAN_KICKSTART_TIME
-    static unsigned long fan_kick_end;
-    if (tail_fan_speed) {
-      if (fan_kick_end == 0) {
-        // Just starting up fan - run at full power.
-        fan_kick_end = millis() + FAN_KICKSTART_TIME;
-        tail_fan_speed = 255;
-      } else if (fan_kick_end > millis())
-        // Fan still spinning up.
-        tail_fan_speed = 255;
-    } else {
-      fan_kick_end = 0;
-    }
-  #endif//FAN_KICKSTART_TIME
-  #ifdef FAN_SOFT_PWM
-  fanSpeedSoftPwm = tail_fan_speed;
-  #else
-  analogWrite(FAN_PIN,tail_fan_speed);
-  #endif//!FAN_SOFT_PWM
-#endif//FAN_PIN > -1
+  st_update_block_outputs(); // the fan and BariCUDA outputs themselves are set by the stepper interrupt
 #ifdef AUTOTEMP
   getHighESpeed();
 #endif
+}
 
-#ifdef BARICUDA
-  #if defined(HEATER_1_PIN) && HEATER_1_PIN > -1
-      analogWrite(HEATER_1_PIN,tail_valve_pressure);
-  #endif
 
-  #if defined(HEATER_2_PIN) && HEATER_2_PIN > -1
-      analogWrite(HEATER_2_PIN,tail_e_to_p_pressure);
+float junction_deviation = 0.1;
+
+#ifdef PLANNER_UNDERRUN_STATS
+static unsigned long underrun_count = 0;  // the stepper ran out of moves and the next one came later
+static unsigned long underrun_idle = 0;   // ms the steppers stood still in those underruns
+static unsigned long underrun_low = 0;    // ms with fewer than PLANNER_LOW_BLOCKS moves queued
+static unsigned char underrun_min_depth = BLOCK_BUFFER_SIZE; // fewest moves queued when a move was added
+
+// Moves kept coming while the planner was empty: commands are waiting behind this move, an SD print
+// runs or the stop was short. Else the machine was idle, e.g. before a new job or an LCD jog.
+static bool plan_moves_arriving(unsigned long idle)
+{
+  if (commands_queued() > 1) return true;
+  #ifdef SDSUPPORT
+    if (IS_SD_PRINTING) return true;
   #endif
-#endif
+  return idle < PLANNER_UNDERRUN_MAX_IDLE;
 }
 
+// A move was added to depth queued moves, close the empty and low periods the stepper started
+static void plan_underrun_update(unsigned char depth)
+{
+  unsigned long now = millis();
+  CRITICAL_SECTION_START;
+  unsigned long empty_since = planner_empty_since;
+  unsigned long low_since = planner_low_since;
+  planner_empty_since = 0;
+  if (depth + 1 >= PLANNER_LOW_BLOCKS) planner_low_since = 0;
+  CRITICAL_SECTION_END;
+
+  if (empty_since && !plan_moves_arriving(now - empty_since))
+  {
+    // The idle time is neither an underrun nor low, the low period starts over with this move
+    empty_since = 0;
+    low_since = 0;
+    {
+      CRITICAL_SECTION_START;
+      if (planner_low_since) planner_low_since = now | 1;
+      CRITICAL_SECTION_END;
+    }
+  }
+
+  if (empty_since)
+  {
+    underrun_count++;
+    underrun_idle += now - empty_since;
+    underrun_min_depth = 0;
+    #ifdef PLANNER_UNDERRUN_REPORT
+      // No commands waiting means the host or the SD card did not keep up, else the parsing and planning
+      SERIAL_ECHO_START;
+      SERIAL_ECHOPGM("Planner underrun, idle ms:");
+      SERIAL_ECHO(now - empty_since);
+      SERIAL_ECHOPGM(" commands queued:");
+      SERIAL_ECHOLN((int)commands_queued());
+    #endif
+  }
+  else if (depth > 0 && depth < underrun_min_depth)
+    underrun_min_depth = depth; // with none queued the buffer was drained on purpose
+  if (low_since && depth + 1 >= PLANNER_LOW_BLOCKS) underrun_low += now - low_since;
+}
+
+void plan_underrun_ignore()
+{
+  CRITICAL_SECTION_START;
+  planner_empty_since = 0;
+  planner_low_since = 0;
+  CRITICAL_SECTION_END;
+}
+
+void plan_underrun_report()
+{
+  SERIAL_ECHO_START;
+  SERIAL_ECHOPGM("Planner underruns:");
+  SERIAL_ECHO(underrun_count);
+  SERIAL_ECHOPGM(" idle ms:");
+  SERIAL_ECHO(underrun_idle);
+  SERIAL_ECHOPGM(" min queued:");
+  SERIAL_ECHO((int)underrun_min_depth);
+  SERIAL_ECHOPGM(" ms below ");
+  SERIAL_ECHO((int)PLANNER_LOW_BLOCKS);
+  SERIAL_ECHOPGM(" queued:");
+  SERIAL_ECHOLN(underrun_low);
+}
+
+void plan_underrun_reset()
+{
+  underrun_count = 0;
+  underrun_idle = 0;
+  underrun_low = 0;
+  underrun_min_depth = BLOCK_BUFFER_SIZE;
+}
+#endif //PLANNER_UNDERRUN_STATS
+
+// Bring position[] to the current axis_steps_per_unit. Queued blocks keep the steps they were
+// planned with, the stepper interrupt rescales its position when it gets to the blocks planned
+// after the change, so both positions stay in step without waiting for the buffer to drain.
+static void plan_update_steps_per_unit()
+{
+  // Called for every move, only divide when something changed
+  bool changed = false;
+  for(int8_t i=0; i < NUM_AXIS; i++)
+    if (axis_steps_per_unit[i] != position_steps_per_unit[i]) changed = true;
+  if (!changed) return;
+
+  float scale[NUM_AXIS];
+  for(int8_t i=0; i < NUM_AXIS; i++)
+    scale[i] = axis_steps_per_unit[i] / position_steps_per_unit[i];
+
+  // Each pending version takes a slot until the stepper starts its first block
+  while(blocks_queued() && (unsigned char)(steps_version - st_steps_version) >= STEPS_VERSIONS)
+  {
+    scheduler_run();
+  }
+
+  unsigned char version = steps_version + 1;
+  for(int8_t i=0; i < NUM_AXIS; i++)
+  {
+    steps_rescale[version % STEPS_VERSIONS][i] = scale[i];
+    position[i] = lround(position[i] * scale[i]);
+  }
+  memcpy(position_steps_per_unit, axis_steps_per_unit, sizeof(position_steps_per_unit));
+  // Keep the acceleration limits in mm/s^2, recomputed as M501, M502 or M201 may have done it already
+  reset_acceleration_rates();
+
+  CRITICAL_SECTION_START;
+  steps_version = version;
+  if (!blocks_queued()) st_set_steps_version(version); // the stepper is idle, catch up now
+  CRITICAL_SECTION_END;
+}
 
-float junction_deviation = 0.1;
 // Add a new linear movement to the buffer. steps_x, _y and _z is the absolute position in 
 // mm. Microseconds specify how many microseconds the move should take to perform. To aid acceleration
 // calculation the caller must also provide the physical length of the line in millimeters.
@@ -541,18 +656,20 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
   // Rest here until there is room in the buffer.
   while(block_buffer_tail == next_buffer_head)
   {
-    manage_heater(); 
-    manage_inactivity(); 
-    lcd_update();
+    scheduler_run();
   }
 
+#ifdef AUTO_BED_LEVELING_MESH
+  if (mesh_active) z += mesh_get_z_offset(x, y);
+#endif // AUTO_BED_LEVELING_MESH
 #ifdef ENABLE_AUTO_BED_LEVELING
   apply_rotation_xyz(plan_bed_level_matrix, x, y, z);
 #endif // ENABLE_AUTO_BED_LEVELING
 
+  plan_update_steps_per_unit();
+
   // The target position of the tool in absolute steps
   // Calculate target position in absolute steps
-  //this should be done after the wait, because otherwise a M92 code within the gcode disrupts this calculation somehow
   long target[4];
   target[X_AXIS] = lround(x*axis_steps_per_unit[X_AXIS]);
   target[Y_AXIS] = lround(y*axis_steps_per_unit[Y_AXIS]);
@@ -585,6 +702,7 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
 
   // Mark block as not busy (Not executed by the stepper interrupt)
   block->busy = false;
+  block->steps_version = steps_version;
 
   // Number of steps for each axis
 #ifndef COREXY
@@ -781,45 +899,9 @@ Having the real displacement of the head, we can calculate the total movement le
   block->nominal_rate = ceil(block->step_event_count * inverse_second); // (step/sec) Always > 0
 
 #ifdef FILAMENT_SENSOR
-  //FMM update ring buffer used for delay with filament measurements
-  
-  
-    if((extruder==FILAMENT_SENSOR_EXTRUDER_NUM) && (delay_index2 > -1))  //only for extruder with filament sensor and if ring buffer is initialized
-  	  {
-    delay_dist = delay_dist + delta_mm[E_AXIS];  //increment counter with next move in e axis
-  
-    while (delay_dist >= (10*(MAX_MEASUREMENT_DELAY+1)))  //check if counter is over max buffer size in mm
-      	  delay_dist = delay_dist - 10*(MAX_MEASUREMENT_DELAY+1);  //loop around the buffer
-    while (delay_dist<0)
-    	  delay_dist = delay_dist + 10*(MAX_MEASUREMENT_DELAY+1); //loop around the buffer
-      
-    delay_index1=delay_dist/10.0;  //calculate index
-    
-    //ensure the number is within range of the array after converting from floating point
-    if(delay_index1<0)
-    	delay_index1=0;
-    else if (delay_index1>MAX_MEASUREMENT_DELAY)
-    	delay_index1=MAX_MEASUREMENT_DELAY;
-    	
-    if(delay_index1 != delay_index2)  //moved index
-  	  {
-    	meas_sample=widthFil_to_size_ratio()-100;  //subtract off 100 to reduce magnitude - to store in a signed char
-  	  }
-    while( delay_index1 != delay_index2)
-  	  {
-  	  delay_index2 = delay_index2 + 1;
-  	if(delay_index2>MAX_MEASUREMENT_DELAY)
-  			  delay_index2=delay_index2-(MAX_MEASUREMENT_DELAY+1);  //loop around buffer when incrementing
-  	  if(delay_index2<0)
-  		delay_index2=0;
-  	  else if (delay_index2>MAX_MEASUREMENT_DELAY)
-  		delay_index2=MAX_MEASUREMENT_DELAY;  
-  	  
-  	  measurement_delay[delay_index2]=meas_sample;
-  	  }
-    	
-    
-  	  }
+  // Store the width reading with the filament position and pick the multiplier for the next move
+  if(extruder == FILAMENT_SENSOR_EXTRUDER_NUM)
+    filwidth_planned_move(delta_mm[E_AXIS]);
 #endif
 
 
@@ -833,6 +915,18 @@ Having the real displacement of the head, we can calculate the total movement le
       speed_factor = min(speed_factor, max_feedrate[i] / fabs(current_speed[i]));
   }
 
+#ifdef VOLUMETRIC_FLOW_LIMIT
+  // Limit printing moves to the flow the hotend can melt, retracts and their recovery are left alone
+  if(max_volumetric_flow[extruder] > 0 && current_speed[E_AXIS] > 0 && (block->steps_x != 0 || block->steps_y != 0))
+  {
+    // E is in mm of filament here, without M200 the filament has the nominal diameter
+    float diameter = (volumetric_enabled && filament_size[extruder] > 0) ? filament_size[extruder] : DEFAULT_NOMINAL_FILAMENT_DIA;
+    float flow = current_speed[E_AXIS] * (M_PI / 4.0) * square(diameter);
+    if(flow > max_volumetric_flow[extruder])
+      speed_factor = min(speed_factor, max_volumetric_flow[extruder] / flow);
+  }
+#endif
+
   // Max segement time in us.
 #ifdef XY_FREQUENCY_LIMIT
 #define MAX_FREQ_TIME (1000000.0/XY_FREQUENCY_LIMIT)
@@ -1024,8 +1118,20 @@ Having the real displacement of the head, we can calculate the total movement le
   calculate_trapezoid_for_block(block, block->entry_speed/block->nominal_speed,
   safe_speed/block->nominal_speed);
 
-  // Move buffer head
+  // Move buffer head. The stepper interrupt counts the axes down when it discards blocks.
+  CRITICAL_SECTION_START;
+  if (block->steps_x != 0) axis_blocks[X_AXIS]++;
+  if (block->steps_y != 0) axis_blocks[Y_AXIS]++;
+  if (block->steps_z != 0) axis_blocks[Z_AXIS]++;
+  if (block->steps_e != 0) axis_blocks[E_AXIS]++;
+  #ifdef PLANNER_UNDERRUN_STATS
+    unsigned char depth = (block_buffer_head - block_buffer_tail) & (BLOCK_BUFFER_SIZE - 1);
+  #endif
   block_buffer_head = next_buffer_head;
+  CRITICAL_SECTION_END;
+  #ifdef PLANNER_UNDERRUN_STATS
+    plan_underrun_update(depth);
+  #endif
 
   // Update position
   memcpy(position, target, sizeof(target)); // position[] = target[]
@@ -1045,25 +1151,51 @@ vector_3 plan_get_position() {
 	//inverse.debug("in plan_get inverse");
 	position.apply_rotation(inverse);
 	//position.debug("after rotation");
+#ifdef AUTO_BED_LEVELING_MESH
+	if (mesh_active) position.z -= mesh_get_z_offset(position.x, position.y);
+#endif // AUTO_BED_LEVELING_MESH
 
 	return position;
 }
 #endif // ENABLE_AUTO_BED_LEVELING
 
+#ifdef AUTO_BED_LEVELING_MESH
+float mesh_get_z_offset(float x, float y)
+{
+  float fx = (x - LEFT_PROBE_BED_POSITION) / float(MESH_X_DIST);
+  float fy = (y - FRONT_PROBE_BED_POSITION) / float(MESH_Y_DIST);
+  int cx = constrain((int)floor(fx), 0, AUTO_BED_LEVELING_GRID_POINTS - 2);
+  int cy = constrain((int)floor(fy), 0, AUTO_BED_LEVELING_GRID_POINTS - 2);
+  fx -= cx;
+  fy -= cy;
+  float z_front = mesh_z_values[cy][cx] + (mesh_z_values[cy][cx + 1] - mesh_z_values[cy][cx]) * fx;
+  float z_back = mesh_z_values[cy + 1][cx] + (mesh_z_values[cy + 1][cx + 1] - mesh_z_values[cy + 1][cx]) * fx;
+  return z_front + (z_back - z_front) * fy;
+}
+#endif // AUTO_BED_LEVELING_MESH
+
 #ifdef ENABLE_AUTO_BED_LEVELING
 void plan_set_position(float x, float y, float z, const float &e)
 {
+#ifdef AUTO_BED_LEVELING_MESH
+  if (mesh_active) z += mesh_get_z_offset(x, y);
+#endif // AUTO_BED_LEVELING_MESH
   apply_rotation_xyz(plan_bed_level_matrix, x, y, z);
 #else
 void plan_set_position(const float &x, const float &y, const float &z, const float &e)
 {
 #endif // ENABLE_AUTO_BED_LEVELING
 
+  plan_update_steps_per_unit();
   position[X_AXIS] = lround(x*axis_steps_per_unit[X_AXIS]);
   position[Y_AXIS] = lround(y*axis_steps_per_unit[Y_AXIS]);
   position[Z_AXIS] = lround(z*axis_steps_per_unit[Z_AXIS]);     
   position[E_AXIS] = lround(e*axis_steps_per_unit[E_AXIS]);  
+  CRITICAL_SECTION_START;
+  // The position is in the current steps per unit, the stepper must not rescale it again at a later block
+  st_set_steps_version(steps_version);
   st_set_position(position[X_AXIS], position[Y_AXIS], position[Z_AXIS], position[E_AXIS]);
+  CRITICAL_SECTION_END;
   previous_nominal_speed = 0.0; // Resets planner junction speeds. Assumes start from rest.
   previous_speed[0] = 0.0;
   previous_speed[1] = 0.0;
@@ -1073,8 +1205,13 @@ void plan_set_position(const float &x, const float &y, const float &z, const flo
 
 void plan_set_e_position(const float &e)
 {
+  plan_update_steps_per_unit();
   position[E_AXIS] = lround(e*axis_steps_per_unit[E_AXIS]);  
+  CRITICAL_SECTION_START;
+  // As in plan_set_position(), G92 E does not wait for the moves planned with the old steps per unit
+  st_set_steps_version(steps_version);
   st_set_e_position(position[E_AXIS]);
+  CRITICAL_SECTION_END;
 }
 
 uint8_t movesplanned()
@@ -63,19 +63,40 @@ typedef struct {
   unsigned long initial_rate;                        // The jerk-adjusted step rate at start of block  
   unsigned long final_rate;                          // The minimal rate at exit
   unsigned long acceleration_st;                     // acceleration steps/sec^2
-  unsigned long fan_speed;
+  unsigned char fan_speed;       // Applied by the stepper interrupt when the block starts
   #ifdef BARICUDA
-  unsigned long valve_pressure;
-  unsigned long e_to_p_pressure;
+  unsigned char valve_pressure;
+  unsigned char e_to_p_pressure;
   #endif
+  unsigned char steps_version;   // Steps per unit the block was planned with, see steps_rescale
   volatile char busy;
 } block_t;
 
+// Steps per unit changes (M92, M501, M502, the LCD) take effect with the next planned move, the
+// queued moves run out as they were planned. steps_rescale[v % STEPS_VERSIONS] holds the factor from
+// version v-1 to v, the stepper interrupt scales its position by it when it starts the first block of v.
+#define STEPS_VERSIONS 4
+extern float steps_rescale[STEPS_VERSIONS][NUM_AXIS];
+
 #ifdef ENABLE_AUTO_BED_LEVELING
 // this holds the required transform to compensate for bed level
 extern matrix_3x3 plan_bed_level_matrix;
 #endif // #ifdef ENABLE_AUTO_BED_LEVELING
 
+#ifdef AUTO_BED_LEVELING_MESH
+// Spacing of the mesh grid lines, the same lattice G29 probes
+#define MESH_X_DIST ((RIGHT_PROBE_BED_POSITION - LEFT_PROBE_BED_POSITION) / (AUTO_BED_LEVELING_GRID_POINTS - 1))
+#define MESH_Y_DIST ((BACK_PROBE_BED_POSITION - FRONT_PROBE_BED_POSITION) / (AUTO_BED_LEVELING_GRID_POINTS - 1))
+
+// Bed height at each probed point, [y][x] starting at the front left corner
+extern float mesh_z_values[AUTO_BED_LEVELING_GRID_POINTS][AUTO_BED_LEVELING_GRID_POINTS];
+extern bool mesh_valid;  // mesh_z_values holds a probed (or stored) mesh
+extern bool mesh_active; // the mesh is applied by plan_buffer_line() and plan_set_position()
+
+// Bilinear interpolation of the mesh at x,y. Outside the probed area the edge cells are extrapolated.
+float mesh_get_z_offset(float x, float y);
+#endif // AUTO_BED_LEVELING_MESH
+
 // Initialize the motion plan subsystem      
 void plan_init();
 
@@ -117,6 +138,9 @@ extern float max_z_jerk;
 extern float max_e_jerk;
 extern float mintravelfeedrate;
 extern unsigned long axis_steps_per_sqr_second[NUM_AXIS];
+#ifdef VOLUMETRIC_FLOW_LIMIT
+extern float max_volumetric_flow[EXTRUDERS]; // mm^3/s each extruder may extrude, 0 for no limit. M213
+#endif
 
 #ifdef AUTOTEMP
     extern bool autotemp_enabled;
@@ -125,18 +149,47 @@ extern unsigned long axis_steps_per_sqr_second[NUM_AXIS];
     extern float autotemp_factor;
 #endif
 
+#ifdef PID_ADD_EXTRUSION_RATE
+// Filament volume per second (mm^3/s) the queued moves will extrude with the given extruder
+float plan_extrusion_rate(uint8_t extruder);
+#endif
+
     
 
 
 extern block_t block_buffer[BLOCK_BUFFER_SIZE];            // A ring buffer for motion instfructions
 extern volatile unsigned char block_buffer_head;           // Index of the next block to be pushed
 extern volatile unsigned char block_buffer_tail; 
+extern volatile unsigned char axis_blocks[NUM_AXIS];       // Number of queued blocks that move each axis
+
+#ifdef PLANNER_UNDERRUN_STATS
+// millis() | 1 when the queue ran empty or below PLANNER_LOW_BLOCKS, 0 while it is not
+extern volatile unsigned long planner_empty_since;
+extern volatile unsigned long planner_low_since;
+
+void plan_underrun_ignore(); // the queue is drained on purpose, don't count it
+void plan_underrun_report();
+void plan_underrun_reset();
+#else
+FORCE_INLINE void plan_underrun_ignore() {}
+#endif
+
 // Called when the current block is no longer needed. Discards the block and makes the memory
 // availible for new blocks.    
 FORCE_INLINE void plan_discard_current_block()  
 {
   if (block_buffer_head != block_buffer_tail) {
+    block_t *block = &block_buffer[block_buffer_tail];
+    if (block->steps_x != 0) axis_blocks[X_AXIS]--;
+    if (block->steps_y != 0) axis_blocks[Y_AXIS]--;
+    if (block->steps_z != 0) axis_blocks[Z_AXIS]--;
+    if (block->steps_e != 0) axis_blocks[E_AXIS]--;
     block_buffer_tail = (block_buffer_tail + 1) & (BLOCK_BUFFER_SIZE - 1);  
+    #ifdef PLANNER_UNDERRUN_STATS
+      unsigned char depth = (block_buffer_head - block_buffer_tail) & (BLOCK_BUFFER_SIZE - 1);
+      if (depth < PLANNER_LOW_BLOCKS && !planner_low_since) planner_low_since = millis() | 1;
+      if (depth == 0) planner_empty_since = millis() | 1;
+    #endif
   }
 }
 
@@ -0,0 +1,71 @@
+#include "Marlin.h"
+#include "profiling.h"
+
+#ifdef CPU_PROFILING
+
+profile_counter_t profile_counters[PROFILE_COUNTERS];
+static unsigned long profile_since = 0; // millis() of the last reset
+
+// Microseconds per tick of the clock each counter is timed with
+static float profile_tick_us(unsigned char counter)
+{
+  switch (counter)
+  {
+    case PROFILE_STEPPER:
+      return 8000000.0 / F_CPU;  // timer 1, prescaler 8
+    case PROFILE_TEMPERATURE:
+    case PROFILE_SERIAL_RX:
+    case PROFILE_ADC:
+      return 64000000.0 / F_CPU; // timer 0, prescaler 64
+    default:
+      return 1;                  // micros()
+  }
+}
+
+void profile_report()
+{
+  profile_counter_t counters[PROFILE_COUNTERS];
+  CRITICAL_SECTION_START;
+  memcpy(counters, profile_counters, sizeof(counters));
+  CRITICAL_SECTION_END;
+  unsigned long elapsed = max(millis() - profile_since, 1);
+
+  static const char name_stepper[] PROGMEM = "stepper ISR";
+  static const char name_temperature[] PROGMEM = "temperature ISR";
+  static const char name_serial[] PROGMEM = "serial RX ISR";
+  static const char name_adc[] PROGMEM = "ADC ISR";
+  static const char name_commands[] PROGMEM = "loop commands";
+  static const char name_tasks[] PROGMEM = "loop tasks";
+  static const char * const names[PROFILE_COUNTERS] = { name_stepper, name_temperature, name_serial, name_adc, name_commands, name_tasks };
+
+  for (unsigned char i = 0; i < PROFILE_COUNTERS; i++)
+  {
+    float tick_us = profile_tick_us(i);
+    SERIAL_ECHO_START;
+    serialprintPGM(names[i]);
+    SERIAL_ECHOPGM(" runs:");
+    SERIAL_ECHO(counters[i].count);
+    SERIAL_ECHOPGM(" avg us:");
+    SERIAL_ECHO(counters[i].count ? counters[i].time * tick_us / counters[i].count : 0);
+    SERIAL_ECHOPGM(" max us:");
+    SERIAL_ECHO(counters[i].max_time * tick_us);
+    SERIAL_ECHOPGM(" load %:");
+    SERIAL_ECHO(counters[i].time * tick_us / elapsed / 10);
+    if (i == PROFILE_STEPPER || i == PROFILE_TEMPERATURE)
+    {
+      SERIAL_ECHOPGM(" max latency us:");
+      SERIAL_ECHO(counters[i].max_latency * tick_us);
+    }
+    SERIAL_ECHOLN("");
+  }
+}
+
+void profile_reset()
+{
+  CRITICAL_SECTION_START;
+  memset(profile_counters, 0, sizeof(profile_counters));
+  CRITICAL_SECTION_END;
+  profile_since = millis();
+}
+
+#endif //CPU_PROFILING
@@ -0,0 +1,76 @@
+#ifndef PROFILING_H
+#define PROFILING_H
+
+#include "Marlin.h"
+
+#ifdef CPU_PROFILING
+
+// Time spent in the interrupts and the main loop, reported by M253.
+// The stepper interrupt is timed with timer 1 (0.5 us at 16 MHz). Timer 1 restarts on each stepper
+// interrupt, so its value on entry is also the latency of the interrupt. The temperature, ADC and serial
+// interrupts are timed with timer 0 (4 us, evens out over many runs). The latency of the temperature
+// interrupt is how far timer 0 got past OCR0B. The main loop is timed with micros().
+
+enum { PROFILE_STEPPER, PROFILE_TEMPERATURE, PROFILE_SERIAL_RX, PROFILE_ADC, PROFILE_COMMANDS, PROFILE_TASKS, PROFILE_COUNTERS };
+
+typedef struct {
+  unsigned long count;
+  unsigned long time;         // in ticks of the clock the counter is timed with
+  unsigned long max_time;
+  unsigned int max_latency;
+} profile_counter_t;
+
+extern profile_counter_t profile_counters[PROFILE_COUNTERS];
+
+FORCE_INLINE void profile_add(unsigned char counter, unsigned long time)
+{
+  profile_counter_t *c = &profile_counters[counter];
+  c->count++;
+  c->time += time;
+  if (time > c->max_time) c->max_time = time;
+}
+
+FORCE_INLINE void profile_latency(unsigned char counter, unsigned int latency)
+{
+  if (latency > profile_counters[counter].max_latency) profile_counters[counter].max_latency = latency;
+}
+
+// Timer 1 ticks since start. Timer 1 runs in CTC mode, when a long run of the stepper interrupt reaches
+// the OCR1A it has just set, the timer restarts from 0 and OCF1A is set.
+FORCE_INLINE unsigned long profile_stepper_time(unsigned int start)
+{
+  unsigned int now = TCNT1;
+  bool restarted = TIFR1 & (1<<OCF1A);
+  unsigned int again = TCNT1;
+  if (again < now) { // restarted between the reads
+    now = again;
+    restarted = true;
+  }
+  return restarted ? (unsigned long)OCR1A + 1 - start + now : (unsigned int)(now - start);
+}
+
+#define PROFILE_STEPPER_START unsigned int profile_start = TCNT1; profile_latency(PROFILE_STEPPER, profile_start)
+#define PROFILE_STEPPER_END profile_add(PROFILE_STEPPER, profile_stepper_time(profile_start))
+#define PROFILE_TEMPERATURE_START unsigned char profile_start = TCNT0; profile_latency(PROFILE_TEMPERATURE, (unsigned char)(profile_start - OCR0B))
+#define PROFILE_TIMER0_START unsigned char profile_start = TCNT0
+#define PROFILE_TIMER0_END(counter) profile_add(counter, (unsigned char)(TCNT0 - profile_start))
+#define PROFILE_LOOP_START unsigned long profile_mark = micros()
+// Count the time since the last mark to counter and start the next phase
+#define PROFILE_LOOP_MARK(counter) do { unsigned long profile_now = micros(); profile_add(counter, profile_now - profile_mark); profile_mark = profile_now; } while(0)
+
+void profile_report();
+void profile_reset();
+
+#else
+
+#define PROFILE_STEPPER_START
+#define PROFILE_STEPPER_END
+#define PROFILE_TEMPERATURE_START
+#define PROFILE_TIMER0_START
+#define PROFILE_TIMER0_END(counter)
+#define PROFILE_LOOP_START
+#define PROFILE_LOOP_MARK(counter)
+
+#endif //CPU_PROFILING
+
+#endif //PROFILING_H
@@ -2,21 +2,29 @@
 
 #ifdef AUTO_BED_LEVELING_GRID
 
-void daxpy ( int n, double da, double dx[], int incx, double dy[], int incy );
-double ddot ( int n, double dx[], int incx, double dy[], int incy );
-double dnrm2 ( int n, double x[], int incx );
-void dqrank ( double a[], int lda, int m, int n, double tol, int *kr, 
-  int jpvt[], double qraux[] );
-void dqrdc ( double a[], int lda, int n, int p, double qraux[], int jpvt[], 
-  double work[], int job );
-int dqrls ( double a[], int lda, int m, int n, double tol, int *kr, double b[], 
-  double x[], double rsd[], int jpvt[], double qraux[], int itask );
-void dqrlss ( double a[], int lda, int m, int n, int kr, double b[], double x[], 
-  double rsd[], int jpvt[], double qraux[] );
-int dqrsl ( double a[], int lda, int n, int k, double qraux[], double y[], 
-  double qy[], double qty[], double b[], double rsd[], double ab[], int job );
-void dscal ( int n, double sa, double x[], int incx );
-void dswap ( int n, double x[], int incx, double y[], int incy );
-double *qr_solve ( int m, int n, double a[], double b[] );
+// Largest number of unknowns the solver handles. The plane fit of G29 needs 3.
+#ifndef LSQ_MAX_COLUMNS
+  #define LSQ_MAX_COLUMNS 3
+#endif
+
+// Linear least squares solver for min |A x - b| with a few unknowns.
+// The rows of A are folded one at a time into the triangular factor R of a
+// QR decomposition by Givens rotations, so neither A nor any scratch array
+// has to be kept and nothing is allocated on the heap.
+struct lsq_solver
+{
+  unsigned char n;                               // number of unknowns
+  double r[LSQ_MAX_COLUMNS][LSQ_MAX_COLUMNS + 1]; // R in the upper triangle, Q^T b in the last used column
+};
+
+// Start a new problem with n unknowns (n <= LSQ_MAX_COLUMNS)
+void lsq_init(lsq_solver &lsq, unsigned char n);
+
+// Add the equation row[0]*x[0] + ... + row[n-1]*x[n-1] = b
+void lsq_add_row(lsq_solver &lsq, const double row[], double b);
+
+// Back substitute the solution into x[n]. Returns false if the rows added so far
+// do not determine all unknowns (e.g. all probe points on one line).
+bool lsq_solve(lsq_solver &lsq, double x[]);
 
 #endif
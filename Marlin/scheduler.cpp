@@ -0,0 +1,114 @@
+#include "Marlin.h"
+#include "scheduler.h"
+#include "temperature.h"
+#include "stepper.h"
+#include "ultralcd.h"
+
+static task_t tasks[SCHEDULER_MAX_TASKS];
+static unsigned char task_count = 0;
+static bool inactivity_ignore_stepper_queue = false;
+
+static void task_inactivity()
+{
+  manage_inactivity(inactivity_ignore_stepper_queue);
+}
+
+static void task_lcd()
+{
+  lcd_update();
+}
+
+void scheduler_init()
+{
+  // The heater control has to keep up with the temperature readings, every 164 ms
+  scheduler_add(manage_heater, PSTR("heater"), 0, 200, 0, TASK_FIXED_PERIOD);
+  // Reads the serial port while waiting and counts the kill pin debounce in passes, keep it on every pass
+  scheduler_add(task_inactivity, PSTR("inactivity"), 0, 100, 1, TASK_FIXED_PERIOD);
+  // Only after a command finished, homing clears the endstop hits at its end
+  scheduler_add(checkHitEndstops, PSTR("endstops"), 0, 0, 2, TASK_LOOP_ONLY);
+  scheduler_add(task_lcd, PSTR("lcd"), 0, 1000, 3);
+}
+
+bool scheduler_add(void (*run)(), const char *name, unsigned int period, unsigned int deadline, unsigned char priority, unsigned char flags)
+{
+  if (task_count >= SCHEDULER_MAX_TASKS) return false;
+  // Keep the list sorted by priority, tasks of the same priority in the order they were added
+  unsigned char i = task_count++;
+  while (i > 0 && tasks[i - 1].priority > priority)
+  {
+    tasks[i] = tasks[i - 1];
+    i--;
+  }
+  memset(&tasks[i], 0, sizeof(task_t));
+  tasks[i].run = run;
+  tasks[i].name = name;
+  tasks[i].period = period;
+  tasks[i].deadline = deadline;
+  tasks[i].priority = priority;
+  tasks[i].flags = flags;
+  tasks[i].last_run = millis();
+  return true;
+}
+
+void scheduler_run(bool in_loop, bool ignore_stepper_queue)
+{
+  inactivity_ignore_stepper_queue = ignore_stepper_queue;
+  for (unsigned char i = 0; i < task_count; i++)
+  {
+    task_t *task = &tasks[i];
+    if (!in_loop && (task->flags & TASK_LOOP_ONLY)) continue;
+    unsigned long now = millis();
+    unsigned long waited = now - task->last_run;
+    if (waited < task->period) continue;
+    if (task->deadline && waited - task->period > task->deadline) task->late++;
+    task->last_run = now;
+
+    unsigned long start = micros();
+    task->run();
+    unsigned long took = micros() - start;
+    task->runs++;
+    task->total_us += took;
+    if (took > task->max_us) task->max_us = min(took, 0xFFFF);
+  }
+  inactivity_ignore_stepper_queue = false;
+}
+
+bool scheduler_set_period(unsigned char index, unsigned int period)
+{
+  if (index >= task_count || (tasks[index].flags & TASK_FIXED_PERIOD)) return false;
+  tasks[index].period = period;
+  return true;
+}
+
+void scheduler_report()
+{
+  for (unsigned char i = 0; i < task_count; i++)
+  {
+    task_t *task = &tasks[i];
+    SERIAL_ECHO_START;
+    SERIAL_ECHO((int)i);
+    SERIAL_ECHOPGM(" ");
+    serialprintPGM(task->name);
+    SERIAL_ECHOPGM(" period:");
+    SERIAL_ECHO(task->period);
+    SERIAL_ECHOPGM("ms runs:");
+    SERIAL_ECHO(task->runs);
+    SERIAL_ECHOPGM(" avg us:");
+    SERIAL_ECHO(task->runs ? task->total_us / task->runs : 0);
+    SERIAL_ECHOPGM(" max us:");
+    SERIAL_ECHO(task->max_us);
+    SERIAL_ECHOPGM(" late:");
+    SERIAL_ECHOLN(task->late);
+  }
+}
+
+void scheduler_reset_stats()
+{
+  for (unsigned char i = 0; i < task_count; i++)
+  {
+    tasks[i].runs = 0;
+    tasks[i].total_us = 0;
+    tasks[i].max_us = 0;
+    tasks[i].late = 0;
+  }
+}
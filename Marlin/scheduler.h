@@ -0,0 +1,46 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "Marlin.h"
+
+// The background work of the firmware (heaters, inactivity, endstop reports, LCD) as a list of
+// tasks. scheduler_run() runs the tasks that are due in priority order and keeps their run times.
+// loop() and every blocking wait call it, so they all service the same tasks.
+
+#define SCHEDULER_MAX_TASKS 8
+
+#define TASK_LOOP_ONLY    1 // not run from blocking waits, only from loop()
+#define TASK_FIXED_PERIOD 2 // M252 cannot change the period, the safety checks depend on it
+
+typedef struct {
+  void (*run)();
+  const char *name;           // in PROGMEM
+  unsigned int period;        // ms from one run to the next, 0 runs the task on every pass
+  unsigned int deadline;      // ms a due task may wait before its run counts as late, 0 for no limit
+  unsigned char priority;     // lower runs first
+  unsigned char flags;
+  unsigned long last_run;     // millis() of the last run
+  // Statistics for M252
+  unsigned long runs;
+  unsigned long total_us;
+  unsigned int max_us;
+  unsigned int late;
+} task_t;
+
+// Register the firmware tasks, call once from setup()
+void scheduler_init();
+
+// Add a task, returns false if the list is full
+bool scheduler_add(void (*run)(), const char *name, unsigned int period, unsigned int deadline, unsigned char priority, unsigned char flags = 0);
+
+// One pass over the tasks. in_loop is true only for the call from loop(), ignore_stepper_queue
+// is passed on to manage_inactivity().
+void scheduler_run(bool in_loop = false, bool ignore_stepper_queue = false);
+
+// Change the period of task index, used by M252. False if there is no such task or its period is fixed.
+bool scheduler_set_period(unsigned char index, unsigned int period);
+
+void scheduler_report();
+void scheduler_reset_stats();
+
+#endif //SCHEDULER_H
@@ -26,6 +26,9 @@
 #include "planner.h"
 #include "temperature.h"
 #include "ultralcd.h"
+#include "scheduler.h"
+#include "profiling.h"
+#include "tmc26x.h"
 #include "language.h"
 #include "cardreader.h"
 #include "speed_lookuptable.h"
@@ -65,10 +68,12 @@ static unsigned short OCR1A_nominal;
 static unsigned short step_loops_nominal;
 
 volatile long endstops_trigsteps[3]={0,0,0};
+static long endstops_edge_steps[3]; // position at the first sample that saw the endstop of an axis pressed
 volatile long endstops_stepsTotal,endstops_stepsDone;
 static volatile bool endstop_x_hit=false;
 static volatile bool endstop_y_hit=false;
 static volatile bool endstop_z_hit=false;
+static volatile unsigned char endstops_latched=0; // axes with a trigger position in endstops_trigsteps, kept for M119
 #ifdef ABORT_ON_ENDSTOP_HIT_FEATURE_ENABLED
 bool abort_on_endstop_hit = false;
 #endif
@@ -84,8 +89,16 @@ static bool old_z_min_endstop=false;
 static bool old_z_max_endstop=false;
 
 static bool check_endstops = true;
+#ifdef ENDSTOP_INTERRUPTS_FEATURE
+static bool endstops_need_polling = false; // set if an endstop pin has no interrupt
+static volatile unsigned char endstops_samples = 0; // samples the stepper interrupt still takes after an edge or a block start
+#endif
+#ifdef PARALLEL_HOMING
+static bool endstops_stop_single_axis = false;
+#endif
 
 volatile long count_position[NUM_AXIS] = { 0, 0, 0, 0};
+volatile unsigned char st_steps_version = 0; // steps per unit version count_position is in
 volatile signed char count_direction[NUM_AXIS] = { 1, 1, 1, 1};
 
 //===========================================================================
@@ -94,6 +107,42 @@ volatile signed char count_direction[NUM_AXIS] = { 1, 1, 1, 1};
 
 #define CHECK_ENDSTOPS  if(check_endstops)
 
+// An endstop needs two samples in a row, a single noise spike does not stop the move. The trigger
+// position is the one of the first sample, with the pin interrupts taken right at the edge.
+#define ENDSTOP_TRIGGERED(state, old) ((state) && (old))
+#define ENDSTOP_EDGE(axis, state, old) if ((state) && !(old)) endstops_edge_steps[axis] = count_position[axis]
+
+#ifdef TMC26X_STALLGUARD_HOMING
+// The SG_TST output of a driver is also set while its motor stands or speeds up. On the axes
+// homed with StallGuard the endstop in the homing direction only counts after it was seen
+// released past the acceleration of the current block.
+static const bool stall_endstop_axes[3] = TMC26X_STALLGUARD_HOMING;
+static uint8_t stall_endstops_armed = 0;
+
+static FORCE_INLINE bool endstop_armed(uint8_t axis, bool home, bool state)
+{
+  if (!home || !stall_endstop_axes[axis]) return true;
+  if (!state && (long)step_events_completed > current_block->accelerate_until) stall_endstops_armed |= (1<<axis);
+  return (stall_endstops_armed & (1<<axis)) != 0;
+}
+#else
+  #define endstop_armed(axis, home, state) true
+#endif
+
+// Stop the current block when an endstop is hit. While homing in parallel only the axis
+// whose endstop was hit is stopped, the block ends once none of X, Y and Z is moving.
+#ifdef PARALLEL_HOMING
+  #define ENDSTOP_HIT_STOP(steps) \
+    if (endstops_stop_single_axis) { \
+      current_block->steps = 0; \
+      if (current_block->steps_x == 0 && current_block->steps_y == 0 && current_block->steps_z == 0) \
+        step_events_completed = current_block->step_event_count; \
+    } \
+    else step_events_completed = current_block->step_event_count;
+#else
+  #define ENDSTOP_HIT_STOP(steps) step_events_completed = current_block->step_event_count;
+#endif
+
 // intRes = intIn1 * intIn2 >> 16
 // uses:
 // r26 to store 0
@@ -205,6 +254,25 @@ void checkHitEndstops()
  }
 }
 
+void report_endstop_triggers()
+{
+  if (!endstops_latched) return;
+  SERIAL_PROTOCOLPGM(MSG_ENDSTOP_TRIGGER_POS);
+  if (endstops_latched & (1<<X_AXIS)) {
+    SERIAL_PROTOCOLPGM(" X:");
+    SERIAL_PROTOCOL((float)endstops_trigsteps[X_AXIS]/axis_steps_per_unit[X_AXIS]);
+  }
+  if (endstops_latched & (1<<Y_AXIS)) {
+    SERIAL_PROTOCOLPGM(" Y:");
+    SERIAL_PROTOCOL((float)endstops_trigsteps[Y_AXIS]/axis_steps_per_unit[Y_AXIS]);
+  }
+  if (endstops_latched & (1<<Z_AXIS)) {
+    SERIAL_PROTOCOLPGM(" Z:");
+    SERIAL_PROTOCOL((float)endstops_trigsteps[Z_AXIS]/axis_steps_per_unit[Z_AXIS]);
+  }
+  SERIAL_PROTOCOLLN("");
+}
+
 void endstops_hit_on_purpose()
 {
   endstop_x_hit=false;
@@ -217,6 +285,13 @@ void enable_endstops(bool check)
   check_endstops = check;
 }
 
+#ifdef PARALLEL_HOMING
+void enable_endstops_single_axis(bool single)
+{
+  endstops_stop_single_axis = single;
+}
+#endif
+
 //         __________________________
 //        /|                        |\     _________________         ^
 //       / |                        | \   /|               |\        |
@@ -310,27 +385,298 @@ FORCE_INLINE void trapezoid_generator_reset() {
 
 }
 
+// Check the endstops of the axes moving towards them and stop the current block on a hit.
+// Called from the stepper interrupt, and with ENDSTOP_INTERRUPTS_FEATURE from the endstop
+// pin interrupts. The stepper interrupt after an edge takes the confirming second sample.
+static void update_endstops()
+{
+  if (current_block == NULL) return;
+  unsigned char dir_bits = current_block->direction_bits;
+
+  #ifndef COREXY
+  if ((dir_bits & (1<<X_AXIS)) != 0) {   // stepping along -X axis
+  #else
+  if ((((dir_bits & (1<<X_AXIS)) != 0)&&(dir_bits & (1<<Y_AXIS)) != 0)) {   //-X occurs for -A and -B
+  #endif
+    CHECK_ENDSTOPS
+    {
+      #ifdef DUAL_X_CARRIAGE
+      // with 2 x-carriages, endstops are only checked in the homing direction for the active extruder
+      if ((current_block->active_extruder == 0 && X_HOME_DIR == -1) 
+          || (current_block->active_extruder != 0 && X2_HOME_DIR == -1))
+      #endif          
+      {
+        #if defined(X_MIN_PIN) && X_MIN_PIN > -1
+          bool x_min_endstop=(READ(X_MIN_PIN) != X_MIN_ENDSTOP_INVERTING);
+          ENDSTOP_EDGE(X_AXIS, x_min_endstop, old_x_min_endstop);
+          if(endstop_armed(X_AXIS, X_HOME_DIR == -1, x_min_endstop) && ENDSTOP_TRIGGERED(x_min_endstop, old_x_min_endstop) && (current_block->steps_x > 0)) {
+            endstops_trigsteps[X_AXIS] = endstops_edge_steps[X_AXIS];
+            endstop_x_hit=true;
+            endstops_latched |= (1<<X_AXIS);
+            ENDSTOP_HIT_STOP(steps_x);
+          }
+          old_x_min_endstop = x_min_endstop;
+        #endif
+      }
+    }
+  }
+  else { // +direction
+    CHECK_ENDSTOPS
+    {
+      #ifdef DUAL_X_CARRIAGE
+      // with 2 x-carriages, endstops are only checked in the homing direction for the active extruder
+      if ((current_block->active_extruder == 0 && X_HOME_DIR == 1) 
+          || (current_block->active_extruder != 0 && X2_HOME_DIR == 1))
+      #endif          
+      {
+        #if defined(X_MAX_PIN) && X_MAX_PIN > -1
+          bool x_max_endstop=(READ(X_MAX_PIN) != X_MAX_ENDSTOP_INVERTING);
+          ENDSTOP_EDGE(X_AXIS, x_max_endstop, old_x_max_endstop);
+          if(endstop_armed(X_AXIS, X_HOME_DIR == 1, x_max_endstop) && ENDSTOP_TRIGGERED(x_max_endstop, old_x_max_endstop) && (current_block->steps_x > 0)){
+            endstops_trigsteps[X_AXIS] = endstops_edge_steps[X_AXIS];
+            endstop_x_hit=true;
+            endstops_latched |= (1<<X_AXIS);
+            ENDSTOP_HIT_STOP(steps_x);
+          }
+          old_x_max_endstop = x_max_endstop;
+        #endif
+      }
+    }
+  }
+
+  #ifndef COREXY
+  if ((dir_bits & (1<<Y_AXIS)) != 0) {   // -direction
+  #else
+  if ((((dir_bits & (1<<X_AXIS)) != 0)&&(dir_bits & (1<<Y_AXIS)) == 0)) {   // -Y occurs for -A and +B
+  #endif
+    CHECK_ENDSTOPS
+    {
+      #if defined(Y_MIN_PIN) && Y_MIN_PIN > -1
+        bool y_min_endstop=(READ(Y_MIN_PIN) != Y_MIN_ENDSTOP_INVERTING);
+        ENDSTOP_EDGE(Y_AXIS, y_min_endstop, old_y_min_endstop);
+        if(endstop_armed(Y_AXIS, Y_HOME_DIR == -1, y_min_endstop) && ENDSTOP_TRIGGERED(y_min_endstop, old_y_min_endstop) && (current_block->steps_y > 0)) {
+          endstops_trigsteps[Y_AXIS] = endstops_edge_steps[Y_AXIS];
+          endstop_y_hit=true;
+          endstops_latched |= (1<<Y_AXIS);
+          ENDSTOP_HIT_STOP(steps_y);
+        }
+        old_y_min_endstop = y_min_endstop;
+      #endif
+    }
+  }
+  else { // +direction
+    CHECK_ENDSTOPS
+    {
+      #if defined(Y_MAX_PIN) && Y_MAX_PIN > -1
+        bool y_max_endstop=(READ(Y_MAX_PIN) != Y_MAX_ENDSTOP_INVERTING);
+        ENDSTOP_EDGE(Y_AXIS, y_max_endstop, old_y_max_endstop);
+        if(endstop_armed(Y_AXIS, Y_HOME_DIR == 1, y_max_endstop) && ENDSTOP_TRIGGERED(y_max_endstop, old_y_max_endstop) && (current_block->steps_y > 0)){
+          endstops_trigsteps[Y_AXIS] = endstops_edge_steps[Y_AXIS];
+          endstop_y_hit=true;
+          endstops_latched |= (1<<Y_AXIS);
+          ENDSTOP_HIT_STOP(steps_y);
+        }
+        old_y_max_endstop = y_max_endstop;
+      #endif
+    }
+  }
+
+  if ((dir_bits & (1<<Z_AXIS)) != 0) {   // -direction
+    CHECK_ENDSTOPS
+    {
+      #if defined(Z_MIN_PIN) && Z_MIN_PIN > -1
+        bool z_min_endstop=(READ(Z_MIN_PIN) != Z_MIN_ENDSTOP_INVERTING);
+        ENDSTOP_EDGE(Z_AXIS, z_min_endstop, old_z_min_endstop);
+        if(endstop_armed(Z_AXIS, Z_HOME_DIR == -1, z_min_endstop) && ENDSTOP_TRIGGERED(z_min_endstop, old_z_min_endstop) && (current_block->steps_z > 0)) {
+          endstops_trigsteps[Z_AXIS] = endstops_edge_steps[Z_AXIS];
+          endstop_z_hit=true;
+          endstops_latched |= (1<<Z_AXIS);
+          ENDSTOP_HIT_STOP(steps_z);
+        }
+        old_z_min_endstop = z_min_endstop;
+      #endif
+    }
+  }
+  else { // +direction
+    CHECK_ENDSTOPS
+    {
+      #if defined(Z_MAX_PIN) && Z_MAX_PIN > -1
+        bool z_max_endstop=(READ(Z_MAX_PIN) != Z_MAX_ENDSTOP_INVERTING);
+        ENDSTOP_EDGE(Z_AXIS, z_max_endstop, old_z_max_endstop);
+        if(endstop_armed(Z_AXIS, Z_HOME_DIR == 1, z_max_endstop) && ENDSTOP_TRIGGERED(z_max_endstop, old_z_max_endstop) && (current_block->steps_z > 0)) {
+          endstops_trigsteps[Z_AXIS] = endstops_edge_steps[Z_AXIS];
+          endstop_z_hit=true;
+          endstops_latched |= (1<<Z_AXIS);
+          ENDSTOP_HIT_STOP(steps_z);
+        }
+        old_z_max_endstop = z_max_endstop;
+      #endif
+    }
+  }
+}
+
+// Outputs that follow the queued moves. The stepper interrupt sets them from the values stored
+// in each block when the block starts, so they change exactly where the move changes.
+#define BLOCK_OUTPUT_FAN    0 // fanSpeed
+#define BLOCK_OUTPUT_VALVE  1 // BariCUDA ValvePressure
+#define BLOCK_OUTPUT_E_TO_P 2 // BariCUDA EtoPPressure
+#define BLOCK_OUTPUTS       3
+
+#if defined(FAN_PIN) && FAN_PIN > -1
+  #define BLOCK_OUTPUT_FAN_PIN FAN_PIN
+#else
+  #define BLOCK_OUTPUT_FAN_PIN -1
+#endif
+#if defined(BARICUDA) && defined(HEATER_1_PIN) && HEATER_1_PIN > -1
+  #define BLOCK_OUTPUT_VALVE_PIN HEATER_1_PIN
+#else
+  #define BLOCK_OUTPUT_VALVE_PIN -1
+#endif
+#if defined(BARICUDA) && defined(HEATER_2_PIN) && HEATER_2_PIN > -1
+  #define BLOCK_OUTPUT_E_TO_P_PIN HEATER_2_PIN
+#else
+  #define BLOCK_OUTPUT_E_TO_P_PIN -1
+#endif
+
+static const int8_t block_output_pin[BLOCK_OUTPUTS] = { BLOCK_OUTPUT_FAN_PIN, BLOCK_OUTPUT_VALVE_PIN, BLOCK_OUTPUT_E_TO_P_PIN };
+static volatile uint8_t *block_output_ocr[BLOCK_OUTPUTS];          // compare register of the pin, NULL if the main loop has to write it
+static bool block_output_wide[BLOCK_OUTPUTS];                      // the compare register belongs to a 16 bit timer
+static volatile unsigned char block_output_value[BLOCK_OUTPUTS];   // value of the running block
+static volatile unsigned char block_output_level[BLOCK_OUTPUTS];   // value on the pin, full power while the fan kicks
+static unsigned char block_output_written[BLOCK_OUTPUTS];          // last level passed to analogWrite
+#ifdef FAN_KICKSTART_TIME
+static volatile bool fan_kicking = false;
+static volatile unsigned long fan_kick_end;
+#endif
+
+// Put a level on the pin. Pins without a compare register are written by st_update_block_outputs().
+static FORCE_INLINE void block_output_write(uint8_t i, unsigned char level)
+{
+  block_output_level[i] = level;
+  #ifdef FAN_SOFT_PWM
+    if (i == BLOCK_OUTPUT_FAN) {
+      fanSpeedSoftPwm = level;
+      return;
+    }
+  #endif
+  volatile uint8_t *ocr = block_output_ocr[i];
+  if (ocr == NULL) return;
+  if (block_output_wide[i]) *(volatile uint16_t *)ocr = level;
+  else *ocr = level;
+}
+
+// Called with interrupts off, by the stepper interrupt at the start of a block
+static void block_output_set(uint8_t i, unsigned char value)
+{
+  if (value == block_output_value[i]) return;
+  unsigned char level = value;
+  #ifdef FAN_KICKSTART_TIME
+    if (i == BLOCK_OUTPUT_FAN) {
+      if (value == 0)
+        fan_kicking = false;
+      else if (block_output_value[i] == 0) {
+        // Just starting up the fan, run it at full power until st_update_block_outputs() ends the kick
+        fan_kicking = true;
+        fan_kick_end = millis() + FAN_KICKSTART_TIME;
+      }
+      if (fan_kicking) level = 255;
+    }
+  #endif
+  block_output_value[i] = value;
+  block_output_write(i, level);
+}
+
+static void block_outputs_init()
+{
+  for (uint8_t i = 0; i < BLOCK_OUTPUTS; i++) {
+    int8_t pin = block_output_pin[i];
+    block_output_ocr[i] = NULL;
+    if (pin < 0) continue;
+    #ifdef FAN_SOFT_PWM
+      if (i == BLOCK_OUTPUT_FAN) continue; // switched by the temperature ISR
+    #endif
+    pinMode(pin, OUTPUT);
+    block_output_ocr[i] = pwm_output_register(pin, block_output_wide[i]);
+    // A nonzero analogWrite connects the compare output to the pin, the level then goes into the register
+    analogWrite(pin, block_output_ocr[i] != NULL ? 1 : 0);
+    block_output_value[i] = block_output_written[i] = 0;
+    block_output_write(i, 0);
+  }
+}
+
+void st_update_block_outputs()
+{
+  CRITICAL_SECTION_START;
+  if (current_block == NULL && !blocks_queued()) {
+    // Nothing to wait for, new settings apply right away
+    block_output_set(BLOCK_OUTPUT_FAN, fanSpeed);
+    #ifdef BARICUDA
+      block_output_set(BLOCK_OUTPUT_VALVE, ValvePressure);
+      block_output_set(BLOCK_OUTPUT_E_TO_P, EtoPPressure);
+    #endif
+  }
+  #ifdef FAN_KICKSTART_TIME
+    if (fan_kicking && (long)(millis() - fan_kick_end) >= 0) {
+      fan_kicking = false;
+      block_output_write(BLOCK_OUTPUT_FAN, block_output_value[BLOCK_OUTPUT_FAN]);
+    }
+  #endif
+  CRITICAL_SECTION_END;
+
+  for (uint8_t i = 0; i < BLOCK_OUTPUTS; i++) {
+    if (block_output_pin[i] < 0 || block_output_ocr[i] != NULL) continue;
+    #ifdef FAN_SOFT_PWM
+      if (i == BLOCK_OUTPUT_FAN) continue;
+    #endif
+    unsigned char level = block_output_level[i];
+    if (level != block_output_written[i]) {
+      block_output_written[i] = level;
+      analogWrite(block_output_pin[i], level);
+    }
+  }
+}
+
 // "The Stepper Driver Interrupt" - This timer interrupt is the workhorse.
 // It pops blocks from the block_buffer and executes them by pulsing the stepper pins appropriately.
 ISR(TIMER1_COMPA_vect)
 {
+  PROFILE_STEPPER_START;
   // If there is no current block, attempt to pop one from the buffer
   if (current_block == NULL) {
     // Anything in the buffer?
     current_block = plan_get_current_block();
     if (current_block != NULL) {
       current_block->busy = true;
+      if (current_block->steps_version != st_steps_version) st_set_steps_version(current_block->steps_version);
+      block_output_set(BLOCK_OUTPUT_FAN, current_block->fan_speed);
+      #ifdef BARICUDA
+        block_output_set(BLOCK_OUTPUT_VALVE, current_block->valve_pressure);
+        block_output_set(BLOCK_OUTPUT_E_TO_P, current_block->e_to_p_pressure);
+      #endif
       trapezoid_generator_reset();
       counter_x = -(current_block->step_event_count >> 1);
       counter_y = counter_x;
       counter_z = counter_x;
       counter_e = counter_x;
       step_events_completed = 0;
+      #ifdef TMC26X_STALLGUARD_HOMING
+        stall_endstops_armed = 0;
+      #endif
+
+      // Each block takes its own two samples, so the trigger position is one from this block
+      old_x_min_endstop = old_x_max_endstop = false;
+      old_y_min_endstop = old_y_max_endstop = false;
+      old_z_min_endstop = old_z_max_endstop = false;
+      #ifdef ENDSTOP_INTERRUPTS_FEATURE
+        // No edge comes for an endstop that is already pressed when the move starts
+        endstops_samples = 2;
+      #endif
 
       #ifdef Z_LATE_ENABLE
         if(current_block->steps_z > 0) {
           enable_z();
           OCR1A = 2000; //1ms wait
+          PROFILE_STEPPER_END;
           return;
         }
       #endif
@@ -345,7 +691,7 @@ ISR(TIMER1_COMPA_vect)
   }
 
   if (current_block != NULL) {
-    // Set directions TO DO This should be done once during init of trapezoid. Endstops -> interrupt
+    // Set directions TO DO This should be done once during init of trapezoid.
     out_bits = current_block->direction_bits;
 
 
@@ -403,86 +749,16 @@ ISR(TIMER1_COMPA_vect)
       count_direction[Y_AXIS]=1;
     }
 
-    // Set direction en check limit switches
-    #ifndef COREXY
-    if ((out_bits & (1<<X_AXIS)) != 0) {   // stepping along -X axis
-    #else
-    if ((((out_bits & (1<<X_AXIS)) != 0)&&(out_bits & (1<<Y_AXIS)) != 0)) {   //-X occurs for -A and -B
-    #endif
-      CHECK_ENDSTOPS
+    // Set direction and check limit switches
+    #ifdef ENDSTOP_INTERRUPTS_FEATURE
+      if (endstops_need_polling || endstops_samples)
       {
-        #ifdef DUAL_X_CARRIAGE
-        // with 2 x-carriages, endstops are only checked in the homing direction for the active extruder
-        if ((current_block->active_extruder == 0 && X_HOME_DIR == -1) 
-            || (current_block->active_extruder != 0 && X2_HOME_DIR == -1))
-        #endif          
-        {
-          #if defined(X_MIN_PIN) && X_MIN_PIN > -1
-            bool x_min_endstop=(READ(X_MIN_PIN) != X_MIN_ENDSTOP_INVERTING);
-            if(x_min_endstop && old_x_min_endstop && (current_block->steps_x > 0)) {
-              endstops_trigsteps[X_AXIS] = count_position[X_AXIS];
-              endstop_x_hit=true;
-              step_events_completed = current_block->step_event_count;
-            }
-            old_x_min_endstop = x_min_endstop;
-          #endif
-        }
-      }
-    }
-    else { // +direction
-      CHECK_ENDSTOPS
-      {
-        #ifdef DUAL_X_CARRIAGE
-        // with 2 x-carriages, endstops are only checked in the homing direction for the active extruder
-        if ((current_block->active_extruder == 0 && X_HOME_DIR == 1) 
-            || (current_block->active_extruder != 0 && X2_HOME_DIR == 1))
-        #endif          
-        {
-          #if defined(X_MAX_PIN) && X_MAX_PIN > -1
-            bool x_max_endstop=(READ(X_MAX_PIN) != X_MAX_ENDSTOP_INVERTING);
-            if(x_max_endstop && old_x_max_endstop && (current_block->steps_x > 0)){
-              endstops_trigsteps[X_AXIS] = count_position[X_AXIS];
-              endstop_x_hit=true;
-              step_events_completed = current_block->step_event_count;
-            }
-            old_x_max_endstop = x_max_endstop;
-          #endif
-        }
-      }
-    }
-
-    #ifndef COREXY
-    if ((out_bits & (1<<Y_AXIS)) != 0) {   // -direction
-    #else
-    if ((((out_bits & (1<<X_AXIS)) != 0)&&(out_bits & (1<<Y_AXIS)) == 0)) {   // -Y occurs for -A and +B
+        if (endstops_samples) endstops_samples--;
     #endif
-      CHECK_ENDSTOPS
-      {
-        #if defined(Y_MIN_PIN) && Y_MIN_PIN > -1
-          bool y_min_endstop=(READ(Y_MIN_PIN) != Y_MIN_ENDSTOP_INVERTING);
-          if(y_min_endstop && old_y_min_endstop && (current_block->steps_y > 0)) {
-            endstops_trigsteps[Y_AXIS] = count_position[Y_AXIS];
-            endstop_y_hit=true;
-            step_events_completed = current_block->step_event_count;
-          }
-          old_y_min_endstop = y_min_endstop;
-        #endif
+        update_endstops();
+    #ifdef ENDSTOP_INTERRUPTS_FEATURE
       }
-    }
-    else { // +direction
-      CHECK_ENDSTOPS
-      {
-        #if defined(Y_MAX_PIN) && Y_MAX_PIN > -1
-          bool y_max_endstop=(READ(Y_MAX_PIN) != Y_MAX_ENDSTOP_INVERTING);
-          if(y_max_endstop && old_y_max_endstop && (current_block->steps_y > 0)){
-            endstops_trigsteps[Y_AXIS] = count_position[Y_AXIS];
-            endstop_y_hit=true;
-            step_events_completed = current_block->step_event_count;
-          }
-          old_y_max_endstop = y_max_endstop;
-        #endif
-      }
-    }
+    #endif
 
     if ((out_bits & (1<<Z_AXIS)) != 0) {   // -direction
       WRITE(Z_DIR_PIN,INVERT_Z_DIR);
@@ -492,18 +768,6 @@ ISR(TIMER1_COMPA_vect)
       #endif
 
       count_direction[Z_AXIS]=-1;
-      CHECK_ENDSTOPS
-      {
-        #if defined(Z_MIN_PIN) && Z_MIN_PIN > -1
-          bool z_min_endstop=(READ(Z_MIN_PIN) != Z_MIN_ENDSTOP_INVERTING);
-          if(z_min_endstop && old_z_min_endstop && (current_block->steps_z > 0)) {
-            endstops_trigsteps[Z_AXIS] = count_position[Z_AXIS];
-            endstop_z_hit=true;
-            step_events_completed = current_block->step_event_count;
-          }
-          old_z_min_endstop = z_min_endstop;
-        #endif
-      }
     }
     else { // +direction
       WRITE(Z_DIR_PIN,!INVERT_Z_DIR);
@@ -513,20 +777,7 @@ ISR(TIMER1_COMPA_vect)
       #endif
 
       count_direction[Z_AXIS]=1;
-      CHECK_ENDSTOPS
-      {
-        #if defined(Z_MAX_PIN) && Z_MAX_PIN > -1
-          bool z_max_endstop=(READ(Z_MAX_PIN) != Z_MAX_ENDSTOP_INVERTING);
-          if(z_max_endstop && old_z_max_endstop && (current_block->steps_z > 0)) {
-            endstops_trigsteps[Z_AXIS] = count_position[Z_AXIS];
-            endstop_z_hit=true;
-            step_events_completed = current_block->step_event_count;
-          }
-          old_z_max_endstop = z_max_endstop;
-        #endif
-      }
     }
-
     #ifndef ADVANCE
       if ((out_bits & (1<<E_AXIS)) != 0) {  // -direction
         REV_E_DIR();
@@ -758,6 +1009,7 @@ ISR(TIMER1_COMPA_vect)
       plan_discard_current_block();
     }
   }
+  PROFILE_STEPPER_END;
 }
 
 #ifdef ADVANCE
@@ -817,10 +1069,84 @@ ISR(TIMER1_COMPA_vect)
   }
 #endif // ADVANCE
 
+#ifdef ENDSTOP_INTERRUPTS_FEATURE
+
+// The first sample is taken at the edge, the next stepper interrupt confirms it
+static void endstop_isr()
+{
+  update_endstops();
+  endstops_samples = 1;
+}
+
+// Endstops on pin change interrupts, several endstops may share one vector. Only the vectors
+// of endstop pins without an external interrupt are taken, the others stay free for other code.
+#ifdef digitalPinToInterrupt
+  #define ENDSTOP_ON_PCINT(pin, n) ((pin) > -1 && digitalPinToInterrupt(pin) == NOT_AN_INTERRUPT && digitalPinToPCICRbit(pin) == (n))
+#else
+  #define ENDSTOP_ON_PCINT(pin, n) ((pin) > -1 && digitalPinToPCICRbit(pin) == (n))
+#endif
+#define ENDSTOPS_ON_PCINT(n) (ENDSTOP_ON_PCINT(X_MIN_PIN, n) || ENDSTOP_ON_PCINT(X_MAX_PIN, n) || \
+                              ENDSTOP_ON_PCINT(Y_MIN_PIN, n) || ENDSTOP_ON_PCINT(Y_MAX_PIN, n) || \
+                              ENDSTOP_ON_PCINT(Z_MIN_PIN, n) || ENDSTOP_ON_PCINT(Z_MAX_PIN, n))
+
+#define ENDSTOP_PCINT0 0
+#define ENDSTOP_PCINT1 0
+#define ENDSTOP_PCINT2 0
+#define ENDSTOP_PCINT3 0
+#ifdef digitalPinToPCICRbit
+  #if defined(PCINT0_vect) && ENDSTOPS_ON_PCINT(0)
+    #undef ENDSTOP_PCINT0
+    #define ENDSTOP_PCINT0 _BV(0)
+    ISR(PCINT0_vect) { endstop_isr(); }
+  #endif
+  #if defined(PCINT1_vect) && ENDSTOPS_ON_PCINT(1)
+    #undef ENDSTOP_PCINT1
+    #define ENDSTOP_PCINT1 _BV(1)
+    ISR(PCINT1_vect) { endstop_isr(); }
+  #endif
+  #if defined(PCINT2_vect) && ENDSTOPS_ON_PCINT(2)
+    #undef ENDSTOP_PCINT2
+    #define ENDSTOP_PCINT2 _BV(2)
+    ISR(PCINT2_vect) { endstop_isr(); }
+  #endif
+  #if defined(PCINT3_vect) && ENDSTOPS_ON_PCINT(3)
+    #undef ENDSTOP_PCINT3
+    #define ENDSTOP_PCINT3 _BV(3)
+    ISR(PCINT3_vect) { endstop_isr(); }
+  #endif
+#endif
+#define ENDSTOP_PCINT_VECTORS (ENDSTOP_PCINT0 | ENDSTOP_PCINT1 | ENDSTOP_PCINT2 | ENDSTOP_PCINT3)
+
+// Let an edge on the endstop pin run update_endstops(), preferring an external interrupt over
+// the pin change interrupt. Pins with neither are still polled from the stepper interrupt.
+static void setup_endstop_interrupt(uint8_t pin)
+{
+  #ifdef digitalPinToInterrupt
+    if (digitalPinToInterrupt(pin) != NOT_AN_INTERRUPT) {
+      attachInterrupt(digitalPinToInterrupt(pin), endstop_isr, CHANGE);
+      return;
+    }
+  #endif
+  if (digitalPinToPCICR(pin) != 0 && (ENDSTOP_PCINT_VECTORS & _BV(digitalPinToPCICRbit(pin)))) {
+    *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+    *digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+    return;
+  }
+  endstops_need_polling = true;
+  SERIAL_ECHO_START;
+  SERIAL_ECHOPGM(MSG_ENDSTOP_POLLED);
+  SERIAL_ECHOLN((int)pin);
+}
+
+#endif //ENDSTOP_INTERRUPTS_FEATURE
+
 void st_init()
 {
   digipot_init(); //Initialize Digipot Motor Current
   microstep_init(); //Initialize Microstepping Pins
+  #ifdef HAVE_TMC26X
+    tmc26x_init(); //Configure the TMC26X drivers over SPI
+  #endif
 
   //Initialize Dir Pins
   #if defined(X_DIR_PIN) && X_DIR_PIN > -1
@@ -938,6 +1264,26 @@ void st_init()
     #endif
   #endif
 
+  #ifdef ENDSTOP_INTERRUPTS_FEATURE
+    #if defined(X_MIN_PIN) && X_MIN_PIN > -1
+      setup_endstop_interrupt(X_MIN_PIN);
+    #endif
+    #if defined(X_MAX_PIN) && X_MAX_PIN > -1
+      setup_endstop_interrupt(X_MAX_PIN);
+    #endif
+    #if defined(Y_MIN_PIN) && Y_MIN_PIN > -1
+      setup_endstop_interrupt(Y_MIN_PIN);
+    #endif
+    #if defined(Y_MAX_PIN) && Y_MAX_PIN > -1
+      setup_endstop_interrupt(Y_MAX_PIN);
+    #endif
+    #if defined(Z_MIN_PIN) && Z_MIN_PIN > -1
+      setup_endstop_interrupt(Z_MIN_PIN);
+    #endif
+    #if defined(Z_MAX_PIN) && Z_MAX_PIN > -1
+      setup_endstop_interrupt(Z_MAX_PIN);
+    #endif
+  #endif
 
   //Initialize Step Pins
   #if defined(X_STEP_PIN) && (X_STEP_PIN > -1)
@@ -1001,6 +1347,8 @@ void st_init()
   // create_speed_lookuptable.py
   TCCR1B = (TCCR1B & ~(0x07<<CS10)) | (2<<CS10);
 
+  block_outputs_init();
+
   OCR1A = 0x4000;
   TCNT1 = 0;
   ENABLE_STEPPER_DRIVER_INTERRUPT();
@@ -1025,10 +1373,9 @@ void st_init()
 void st_synchronize()
 {
     while( blocks_queued()) {
-    manage_heater();
-    manage_inactivity();
-    lcd_update();
+    scheduler_run();
   }
+  plan_underrun_ignore();
 }
 
 void st_set_position(const long &x, const long &y, const long &z, const long &e)
@@ -1041,6 +1388,18 @@ void st_set_position(const long &x, const long &y, const long &z, const long &e)
   CRITICAL_SECTION_END;
 }
 
+// Rescale count_position through each steps per unit change up to version, interrupts have to be off
+void st_set_steps_version(unsigned char version)
+{
+  while (st_steps_version != version)
+  {
+    st_steps_version++;
+    const float *scale = steps_rescale[st_steps_version % STEPS_VERSIONS];
+    for(int8_t i=0; i < NUM_AXIS; i++)
+      count_position[i] = lround(count_position[i] * scale[i]);
+  }
+}
+
 void st_set_e_position(const long &e)
 {
   CRITICAL_SECTION_START;
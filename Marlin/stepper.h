@@ -58,6 +58,10 @@ void st_synchronize();
 void st_set_position(const long &x, const long &y, const long &z, const long &e);
 void st_set_e_position(const long &e);
 
+// Steps per unit version of the stepper position, see steps_rescale in planner.h
+extern volatile unsigned char st_steps_version;
+void st_set_steps_version(unsigned char version);
+
 // Get current position in steps
 long st_get_position(uint8_t axis);
 
@@ -73,11 +77,18 @@ void st_wake_up();
   
 void checkHitEndstops(); //call from somewhere to create an serial error message with the locations the endstops where hit, in case they were triggered
 void endstops_hit_on_purpose(); //avoid creation of the message, i.e. after homing and before a routine call of checkHitEndstops();
+void report_endstop_triggers(); //print the position of the last endstop hit of each axis, for M119
 
 void enable_endstops(bool check); // Enable/disable endstop checking
 
+#ifdef PARALLEL_HOMING
+void enable_endstops_single_axis(bool single); // An endstop hit stops only its own axis instead of the whole move
+#endif
+
 void checkStepperErrors(); //Print errors detected by the stepper
 
+void st_update_block_outputs(); // Apply the fan and BariCUDA settings while idle and end the fan kickstart, call from the main loop
+
 void finishAndDisableSteppers();
 
 extern block_t *current_block;  // A pointer to the block currently being traced
@@ -33,6 +33,11 @@
 #include "ultralcd.h"
 #include "temperature.h"
 #include "watchdog.h"
+#include "ConfigurationStore.h"
+#include "profiling.h"
+#if defined(HEATER_EVENT_LOG) && defined(SDSUPPORT)
+  #include "cardreader.h"
+#endif
 
 #include "Sd2PinMap.h"
 
@@ -113,6 +118,37 @@ static volatile bool temp_meas_ready = false;
 	static unsigned long  previous_millis_bed_heater;
 #endif //PIDTEMPBED
   static unsigned char soft_pwm[EXTRUDERS];
+#ifdef HEATER_POWER_BUDGET
+  static unsigned char soft_pwm_bed_request; // bed power asked for by the bed control, before the budget
+#endif
+#ifdef HEATER_HARDWARE_PWM
+  static unsigned char hardware_pwm_heaters = 0;         // bit set for each heater on a timer PWM channel, bit EXTRUDERS is the bed
+  static unsigned char hardware_pwm_value[EXTRUDERS+1]; // last power written to those channels
+  #define SOFT_PWM_HEATER(h) ((hardware_pwm_heaters & (1 << (h))) == 0)
+#else
+  #define SOFT_PWM_HEATER(h) true
+#endif
+#ifdef HEATER_EVENT_LOG
+  struct heater_log_heater {
+    int temp;           // 1/10 degC
+    int target;
+    unsigned char pwm;  // soft PWM value, 0..127
+    int p, i, d;        // PID terms, 0 while the heater is off or outside PID_FUNCTIONAL_RANGE
+  };
+  struct heater_log_entry {
+    unsigned long ms;
+    unsigned char event;        // HEATER_LOG_* fault that ended the log, 0 for a normal update
+    unsigned char event_heater;
+    heater_log_heater heater[EXTRUDERS+1]; // the last entry is the bed
+  };
+  static heater_log_entry heater_log[HEATER_LOG_SIZE];
+  static unsigned char heater_log_head = 0;   // entry written next
+  static unsigned char heater_log_count = 0;
+  static bool heater_log_frozen = false;      // a fault was logged, keep the entries before it
+  static volatile unsigned char heater_log_pending_event = 0;
+  static volatile unsigned char heater_log_pending_heater;
+  static unsigned long heater_log_last_ms;
+#endif
 
 #ifdef FAN_SOFT_PWM
   static unsigned char soft_pwm_fan;
@@ -154,6 +190,9 @@ static int bed_maxttemp_raw = HEATER_BED_RAW_HI_TEMP;
 static float analog2temp(int raw, uint8_t e);
 static float analog2tempBed(int raw);
 static void updateTemperaturesFromRawValues();
+#ifdef HEATER_HARDWARE_PWM
+static void update_hardware_pwm();
+#endif
 
 #ifdef WATCH_TEMP_PERIOD
 int watch_start_temp[EXTRUDERS] = ARRAY_BY_EXTRUDERS(0,0,0);
@@ -164,29 +203,60 @@ unsigned long watchmillis[EXTRUDERS] = ARRAY_BY_EXTRUDERS(0,0,0);
 #define SOFT_PWM_SCALE 0
 #endif
 
-#ifdef FILAMENT_SENSOR
-  static int meas_shift_index;  //used to point to a delayed sample in buffer for filament width sensor
+#ifdef THERMAL_SIMULATION
+  // The readings come from the model, the heater pins are held low
+  #define WRITE_HEATER(pin, v) WRITE(pin, LOW)
+#else
+  #define WRITE_HEATER(pin, v) WRITE(pin, v)
+#endif
+
+#ifdef THERMAL_SIMULATION
+  // Heater model, the last entry is the bed
+  static float sim_block_temp[EXTRUDERS+1];
+  static float sim_sensor_temp[EXTRUDERS+1];
+  static volatile int sim_temp_raw[EXTRUDERS+1]; // picked up by the temperature ISR instead of the ADC
+  #ifdef TEMP_SENSOR_1_AS_REDUNDANT
+    static volatile int sim_redundant_raw;
+  #endif
+  static unsigned long sim_previous_millis;
 #endif
 //===========================================================================
 //=============================   functions      ============================
 //===========================================================================
 
-void PID_autotune(float temp, int extruder, int ncycles)
+// State of one heater during PID_autotune(). The last entry of the arrays is the bed.
+typedef struct {
+  float target;
+  float input;
+  bool heating;
+  bool done;
+  unsigned long t1, t2;
+  long t_high, t_low;
+  long bias, d, pwm_max;
+  int cycles;
+  float max, min;
+  float Ku, Tu;
+} autotune_state;
+
+static void autotune_set_output(uint8_t h, int pwm)
 {
-  float input = 0.0;
-  int cycles=0;
-  bool heating = true;
+  if (h < EXTRUDERS)
+    soft_pwm[h] = pwm;
+  else {
+    soft_pwm_bed = pwm;
+    #ifdef HEATER_POWER_BUDGET
+      soft_pwm_bed_request = pwm;
+    #endif
+  }
+}
 
+// Relay autotune of the heaters in the heaters bit mask (bit EXTRUDERS is the bed), all at the same time.
+// Hotends are tuned at temp, the bed at bed_temp. With apply set the gains are taken over and stored.
+void PID_autotune(float temp, float bed_temp, uint8_t heaters, int ncycles, uint8_t rule, bool apply)
+{
+  autotune_state at[EXTRUDERS+1];
   unsigned long temp_millis = millis();
-  unsigned long t1=temp_millis;
-  unsigned long t2=temp_millis;
-  long t_high = 0;
-  long t_low = 0;
-
-  long bias, d;
-  float Ku, Tu;
-  float Kp, Ki, Kd;
-  float max = 0, min = 10000;
+  uint8_t h;
 
 #if (defined(EXTRUDER_0_AUTO_FAN_PIN) && EXTRUDER_0_AUTO_FAN_PIN > -1) || \
     (defined(EXTRUDER_1_AUTO_FAN_PIN) && EXTRUDER_1_AUTO_FAN_PIN > -1) || \
@@ -194,43 +264,55 @@ void PID_autotune(float temp, int extruder, int ncycles)
   unsigned long extruder_autofan_last_check = millis();
 #endif
 
-  if ((extruder >= EXTRUDERS)
+  if ((heaters == 0) || (heaters >= (2 << EXTRUDERS))
   #if (TEMP_BED_PIN <= -1)
-       ||(extruder < 0)
+       ||(heaters & (1 << EXTRUDERS))
   #endif
        ){
           SERIAL_ECHOLN("PID Autotune failed. Bad extruder number.");
           return;
         }
-	
+  if (ncycles < 3) {
+    // Ku and Tu are measured from the third cycle on
+    SERIAL_ECHOLN("PID Autotune failed. At least 3 cycles are needed.");
+    return;
+  }
+
   SERIAL_ECHOLN("PID Autotune start");
   
   disable_heater(); // switch off all heaters.
 
-  if (extruder<0)
-  {
-     soft_pwm_bed = (MAX_BED_POWER)/2;
-     bias = d = (MAX_BED_POWER)/2;
-   }
-   else
-   {
-     soft_pwm[extruder] = (PID_MAX)/2;
-     bias = d = (PID_MAX)/2;
-  }
-
-
+  // Heaters tuned together share the power budget, lower the relay so that they never ask for more
+  float scale = 1.0;
+  #ifdef HEATER_POWER_BUDGET
+    float watts = 0;
+    for (h = 0; h <= EXTRUDERS; h++)
+      if (heaters & (1 << h)) watts += (h < EXTRUDERS) ? EXTRUDER_WATTS : BED_WATTS;
+    if (watts > HEATER_POWER_BUDGET) scale = HEATER_POWER_BUDGET / watts;
+  #endif
 
+  for (h = 0; h <= EXTRUDERS; h++) {
+    if (!(heaters & (1 << h))) continue;
+    at[h].target = (h < EXTRUDERS) ? temp : bed_temp;
+    at[h].input = 0.0;
+    at[h].heating = true;
+    at[h].done = false;
+    at[h].t1 = at[h].t2 = temp_millis;
+    at[h].t_high = at[h].t_low = 0;
+    at[h].pwm_max = ((h < EXTRUDERS) ? (PID_MAX) : (MAX_BED_POWER)) * scale;
+    at[h].bias = at[h].d = at[h].pwm_max / 2;
+    at[h].cycles = 0;
+    at[h].max = 0;
+    at[h].min = 10000;
+    at[h].Ku = at[h].Tu = 0;
+    autotune_set_output(h, (at[h].bias + at[h].d) >> 1);
+  }
 
  for(;;) {
 
     if(temp_meas_ready == true) { // temp sample ready
       updateTemperaturesFromRawValues();
 
-      input = (extruder<0)?current_temperature_bed:current_temperature[extruder];
-
-      max=max(max,input);
-      min=min(min,input);
-
       #if (defined(EXTRUDER_0_AUTO_FAN_PIN) && EXTRUDER_0_AUTO_FAN_PIN > -1) || \
           (defined(EXTRUDER_1_AUTO_FAN_PIN) && EXTRUDER_1_AUTO_FAN_PIN > -1) || \
           (defined(EXTRUDER_2_AUTO_FAN_PIN) && EXTRUDER_2_AUTO_FAN_PIN > -1)
@@ -240,102 +322,177 @@ void PID_autotune(float temp, int extruder, int ncycles)
       }
       #endif
 
-      if(heating == true && input > temp) {
-        if(millis() - t2 > 5000) { 
-          heating=false;
-          if (extruder<0)
-            soft_pwm_bed = (bias - d) >> 1;
-          else
-            soft_pwm[extruder] = (bias - d) >> 1;
-          t1=millis();
-          t_high=t1 - t2;
-          max=temp;
+      for (h = 0; h <= EXTRUDERS; h++) {
+        if (!(heaters & (1 << h)) || at[h].done) continue;
+        autotune_state &s = at[h];
+
+        s.input = (h < EXTRUDERS) ? current_temperature[h] : current_temperature_bed;
+
+        s.max=max(s.max,s.input);
+        s.min=min(s.min,s.input);
+
+        if(s.heating == true && s.input > s.target) {
+          if(millis() - s.t2 > 5000) { 
+            s.heating=false;
+            autotune_set_output(h, (s.bias - s.d) >> 1);
+            s.t1=millis();
+            s.t_high=s.t1 - s.t2;
+            s.max=s.target;
+          }
         }
-      }
-      if(heating == false && input < temp) {
-        if(millis() - t1 > 5000) {
-          heating=true;
-          t2=millis();
-          t_low=t2 - t1;
-          if(cycles > 0) {
-            bias += (d*(t_high - t_low))/(t_low + t_high);
-            bias = constrain(bias, 20 ,(extruder<0?(MAX_BED_POWER):(PID_MAX))-20);
-            if(bias > (extruder<0?(MAX_BED_POWER):(PID_MAX))/2) d = (extruder<0?(MAX_BED_POWER):(PID_MAX)) - 1 - bias;
-            else d = bias;
-
-            SERIAL_PROTOCOLPGM(" bias: "); SERIAL_PROTOCOL(bias);
-            SERIAL_PROTOCOLPGM(" d: "); SERIAL_PROTOCOL(d);
-            SERIAL_PROTOCOLPGM(" min: "); SERIAL_PROTOCOL(min);
-            SERIAL_PROTOCOLPGM(" max: "); SERIAL_PROTOCOLLN(max);
-            if(cycles > 2) {
-              Ku = (4.0*d)/(3.14159*(max-min)/2.0);
-              Tu = ((float)(t_low + t_high)/1000.0);
-              SERIAL_PROTOCOLPGM(" Ku: "); SERIAL_PROTOCOL(Ku);
-              SERIAL_PROTOCOLPGM(" Tu: "); SERIAL_PROTOCOLLN(Tu);
-              Kp = 0.6*Ku;
-              Ki = 2*Kp/Tu;
-              Kd = Kp*Tu/8;
-              SERIAL_PROTOCOLLNPGM(" Classic PID ");
-              SERIAL_PROTOCOLPGM(" Kp: "); SERIAL_PROTOCOLLN(Kp);
-              SERIAL_PROTOCOLPGM(" Ki: "); SERIAL_PROTOCOLLN(Ki);
-              SERIAL_PROTOCOLPGM(" Kd: "); SERIAL_PROTOCOLLN(Kd);
-              /*
-              Kp = 0.33*Ku;
-              Ki = Kp/Tu;
-              Kd = Kp*Tu/3;
-              SERIAL_PROTOCOLLNPGM(" Some overshoot ");
-              SERIAL_PROTOCOLPGM(" Kp: "); SERIAL_PROTOCOLLN(Kp);
-              SERIAL_PROTOCOLPGM(" Ki: "); SERIAL_PROTOCOLLN(Ki);
-              SERIAL_PROTOCOLPGM(" Kd: "); SERIAL_PROTOCOLLN(Kd);
-              Kp = 0.2*Ku;
-              Ki = 2*Kp/Tu;
-              Kd = Kp*Tu/3;
-              SERIAL_PROTOCOLLNPGM(" No overshoot ");
-              SERIAL_PROTOCOLPGM(" Kp: "); SERIAL_PROTOCOLLN(Kp);
-              SERIAL_PROTOCOLPGM(" Ki: "); SERIAL_PROTOCOLLN(Ki);
-              SERIAL_PROTOCOLPGM(" Kd: "); SERIAL_PROTOCOLLN(Kd);
-              */
+        if(s.heating == false && s.input < s.target) {
+          if(millis() - s.t1 > 5000) {
+            s.heating=true;
+            s.t2=millis();
+            s.t_low=s.t2 - s.t1;
+            if(s.cycles > 0) {
+              s.bias += (s.d*(s.t_high - s.t_low))/(s.t_low + s.t_high);
+              s.bias = constrain(s.bias, 20 ,s.pwm_max-20);
+              if(s.bias > s.pwm_max/2) s.d = s.pwm_max - 1 - s.bias;
+              else s.d = s.bias;
+
+              if (h < EXTRUDERS) {
+                SERIAL_PROTOCOLPGM(" T"); SERIAL_PROTOCOL((int)h);
+              }
+              else
+                SERIAL_PROTOCOLPGM(" B");
+              SERIAL_PROTOCOLPGM(" bias: "); SERIAL_PROTOCOL(s.bias);
+              SERIAL_PROTOCOLPGM(" d: "); SERIAL_PROTOCOL(s.d);
+              SERIAL_PROTOCOLPGM(" min: "); SERIAL_PROTOCOL(s.min);
+              SERIAL_PROTOCOLPGM(" max: "); SERIAL_PROTOCOLLN(s.max);
+              if(s.cycles > 2) {
+                s.Ku = (4.0*s.d)/(3.14159*(s.max-s.min)/2.0);
+                s.Tu = ((float)(s.t_low + s.t_high)/1000.0);
+                SERIAL_PROTOCOLPGM(" Ku: "); SERIAL_PROTOCOL(s.Ku);
+                SERIAL_PROTOCOLPGM(" Tu: "); SERIAL_PROTOCOLLN(s.Tu);
+              }
+            }
+            autotune_set_output(h, (s.bias + s.d) >> 1);
+            s.cycles++;
+            s.min=s.target;
+            if(s.cycles > ncycles) {
+              s.done = true;
+              autotune_set_output(h, 0);
             }
           }
-          if (extruder<0)
-            soft_pwm_bed = (bias + d) >> 1;
-          else
-            soft_pwm[extruder] = (bias + d) >> 1;
-          cycles++;
-          min=temp;
         }
-      } 
+      }
     }
-    if(input > (temp + 20)) {
-      SERIAL_PROTOCOLLNPGM("PID Autotune failed! Temperature too high");
-      return;
+
+    bool all_done = true;
+    for (h = 0; h <= EXTRUDERS; h++) {
+      if (!(heaters & (1 << h)) || at[h].done) continue;
+      all_done = false;
+      if(at[h].input > (at[h].target + 20)) {
+        disable_heater();
+        SERIAL_PROTOCOLLNPGM("PID Autotune failed! Temperature too high");
+        return;
+      }
+      if(((millis() - at[h].t1) + (millis() - at[h].t2)) > (10L*60L*1000L*2L)) {
+        disable_heater();
+        SERIAL_PROTOCOLLNPGM("PID Autotune failed! timeout");
+        return;
+      }
     }
     if(millis() - temp_millis > 2000) {
-      int p;
-      if (extruder<0){
-        p=soft_pwm_bed;       
-        SERIAL_PROTOCOLPGM("ok B:");
-      }else{
-        p=soft_pwm[extruder];       
-        SERIAL_PROTOCOLPGM("ok T:");
+      SERIAL_PROTOCOLPGM("ok");
+      for (h = 0; h <= EXTRUDERS; h++) {
+        if (!(heaters & (1 << h))) continue;
+        if (h < EXTRUDERS) {
+          SERIAL_PROTOCOLPGM(" T");
+          if (heaters != (1 << h)) SERIAL_PROTOCOL((int)h); // plain "ok T:" when tuning a single heater
+          SERIAL_PROTOCOLPGM(":");
+        }
+        else
+          SERIAL_PROTOCOLPGM(" B:");
+        SERIAL_PROTOCOL(at[h].input);
+        SERIAL_PROTOCOLPGM(" @:");
+        SERIAL_PROTOCOL(getHeaterPower(h < EXTRUDERS ? h : -1));
       }
-			
-      SERIAL_PROTOCOL(input);   
-      SERIAL_PROTOCOLPGM(" @:");
-      SERIAL_PROTOCOLLN(p);       
+      SERIAL_PROTOCOLLN("");
 
       temp_millis = millis();
     }
-    if(((millis() - t1) + (millis() - t2)) > (10L*60L*1000L*2L)) {
-      SERIAL_PROTOCOLLNPGM("PID Autotune failed! timeout");
-      return;
+    #ifdef HEATER_HARDWARE_PWM
+      update_hardware_pwm();
+    #endif
+    if(all_done) break;
+    lcd_update();
+  }
+
+  #ifdef HEATER_HARDWARE_PWM
+    update_hardware_pwm();
+  #endif
+
+  // Gains from the ultimate gain and period of every heater
+  float sumKp = 0, sumKi = 0, sumKd = 0;
+  uint8_t hotends = 0;
+  bool tuned = false;
+  for (h = 0; h <= EXTRUDERS; h++) {
+    if (!(heaters & (1 << h))) continue;
+    float Kp, Ki, Kd;
+    float Ku = at[h].Ku, Tu = at[h].Tu;
+    if (Tu == 0) {
+      // no full oscillation was measured, there are no gains to give
+      if (h < EXTRUDERS) {
+        SERIAL_PROTOCOLPGM(" T"); SERIAL_PROTOCOL((int)h);
+      }
+      else
+        SERIAL_PROTOCOLPGM(" B");
+      SERIAL_PROTOCOLLNPGM(" not tuned, no oscillation measured");
+      continue;
+    }
+    tuned = true;
+    if (rule == PID_TUNE_TYREUS_LUYBEN) {
+      Kp = Ku/2.2;
+      Ki = Kp/(2.2*Tu);
+      Kd = Kp*Tu/6.3;
+      SERIAL_PROTOCOLPGM(" Tyreus-Luyben PID");
     }
-    if(cycles > ncycles) {
-      SERIAL_PROTOCOLLNPGM("PID Autotune finished! Put the last Kp, Ki and Kd constants from above into Configuration.h");
-      return;
+    else {
+      Kp = 0.6*Ku;
+      Ki = 2*Kp/Tu;
+      Kd = Kp*Tu/8;
+      SERIAL_PROTOCOLPGM(" Classic PID");
     }
-    lcd_update();
+    if (h < EXTRUDERS) {
+      SERIAL_PROTOCOLPGM(" T"); SERIAL_PROTOCOLLN((int)h);
+      sumKp += Kp; sumKi += Ki; sumKd += Kd;
+      hotends++;
+    }
+    else
+      SERIAL_PROTOCOLLNPGM(" B");
+    SERIAL_PROTOCOLPGM(" Kp: "); SERIAL_PROTOCOLLN(Kp);
+    SERIAL_PROTOCOLPGM(" Ki: "); SERIAL_PROTOCOLLN(Ki);
+    SERIAL_PROTOCOLPGM(" Kd: "); SERIAL_PROTOCOLLN(Kd);
+    #ifdef PIDTEMPBED
+      if (apply && h == EXTRUDERS) {
+        bedKp = Kp;
+        bedKi = scalePID_i(Ki);
+        bedKd = scalePID_d(Kd);
+      }
+    #endif
   }
+  #ifdef PIDTEMP
+    // All hotends share one set of gains, they get the average
+    if (apply && hotends > 0) {
+      Kp = sumKp / hotends;
+      Ki = scalePID_i(sumKi / hotends);
+      Kd = scalePID_d(sumKd / hotends);
+    }
+  #endif
+
+  if (!tuned) {
+    SERIAL_PROTOCOLLNPGM("PID Autotune failed! No heater oscillated");
+    return;
+  }
+  if (apply) {
+    updatePID();
+    Config_StoreSettings();
+    SERIAL_PROTOCOLLNPGM("PID Autotune finished! The new constants are in use");
+  }
+  else
+    SERIAL_PROTOCOLLNPGM("PID Autotune finished! Put the last Kp, Ki and Kd constants from above into Configuration.h");
 }
 
 void updatePID()
@@ -428,6 +585,245 @@ void checkExtruderAutoFans()
 
 #endif // any extruder auto fan pins set
 
+#ifdef HEATER_HARDWARE_PWM
+static int8_t heater_pin(uint8_t h)
+{
+  if (h == EXTRUDERS) {
+    #if defined(HEATER_BED_PIN) && HEATER_BED_PIN > -1
+      return HEATER_BED_PIN;
+    #endif
+  }
+  else if (h == 0) {
+    #if defined(HEATER_0_PIN) && HEATER_0_PIN > -1
+      return HEATER_0_PIN;
+    #endif
+  }
+  else if (h == 1) {
+    #if defined(HEATER_1_PIN) && HEATER_1_PIN > -1
+      return HEATER_1_PIN;
+    #endif
+  }
+  else if (h == 2) {
+    #if defined(HEATER_2_PIN) && HEATER_2_PIN > -1
+      return HEATER_2_PIN;
+    #endif
+  }
+  return -1;
+}
+
+// A pin can only be used for hardware PWM if its timer is free, see pwm_output_register()
+static bool pin_has_free_pwm(int8_t pin)
+{
+  bool wide;
+  return pwm_output_register(pin, wide) != NULL;
+}
+
+// Put the heater power on the hardware PWM channels, the other heaters are switched by the soft PWM in the ISR
+static void update_hardware_pwm()
+{
+  for (uint8_t h = 0; h <= EXTRUDERS; h++) {
+    if (SOFT_PWM_HEATER(h)) continue;
+    unsigned char pwm = (h < EXTRUDERS) ? soft_pwm[h] : soft_pwm_bed;
+    if (pwm == hardware_pwm_value[h]) continue;
+    hardware_pwm_value[h] = pwm;
+    analogWrite(heater_pin(h), pwm << 1);
+    #ifdef HEATERS_PARALLEL
+      if (h == 0) analogWrite(HEATER_1_PIN, pwm << 1);
+    #endif
+  }
+}
+#endif //HEATER_HARDWARE_PWM
+
+#ifdef HEATER_POWER_BUDGET
+// The budget cut the output of heater h below what its PID asked for. Take back the integration of this
+// update like the PID does at its own output limits, or the integrator winds up while the heater is held back.
+static void power_budget_unintegrate(uint8_t h, int requested)
+{
+  #ifdef PIDTEMP
+    if (h < EXTRUDERS && !pid_reset[h] && requested < (PID_MAX >> 1) && pid_error[h] > 0) temp_iState[h] -= pid_error[h];
+  #endif
+  #ifdef PIDTEMPBED
+    if (h == EXTRUDERS && requested < (MAX_BED_POWER >> 1) && pid_error_bed > 0) temp_iState_bed -= pid_error_bed;
+  #endif
+}
+
+// Cut the heater power down to HEATER_POWER_BUDGET. The heaters are served in the order of their distance
+// below the target, so the one that has the longest way to go gets full power.
+static void apply_power_budget()
+{
+  float budget = HEATER_POWER_BUDGET;
+  bool served[EXTRUDERS+1] = { false };  // the last entry is the bed
+
+  for(uint8_t n = 0; n <= EXTRUDERS; n++)
+  {
+    int8_t h = -1;
+    float max_error = -10000;
+    for(uint8_t i = 0; i <= EXTRUDERS; i++)
+    {
+      if(served[i]) continue;
+      float error = (i < EXTRUDERS) ? target_temperature[i] - current_temperature[i] : target_temperature_bed - current_temperature_bed;
+      // Start with the first unserved heater, so a NaN or very low error still picks one
+      if(h < 0 || error > max_error || max_error != max_error) {
+        max_error = error;
+        h = i;
+      }
+    }
+    served[h] = true;
+
+    float watts = (h < EXTRUDERS) ? EXTRUDER_WATTS : BED_WATTS;
+    int pwm = (h < EXTRUDERS) ? soft_pwm[h] : soft_pwm_bed_request;
+    if(pwm * watts / 127 > budget)
+    {
+      int requested = pwm;
+      pwm = budget * 127 / watts;
+      power_budget_unintegrate(h, requested);
+    }
+    budget -= pwm * watts / 127;
+
+    if(h < EXTRUDERS)
+      soft_pwm[h] = pwm;
+    else
+      soft_pwm_bed = pwm;
+  }
+}
+#endif //HEATER_POWER_BUDGET
+
+#ifdef HEATER_EVENT_LOG
+// Mark the next log entry with a fault, the log stops after it. Safe to call from the temperature ISR.
+static void heater_log_event(unsigned char event, unsigned char heater)
+{
+  if (heater_log_pending_event) return; // keep the first fault
+  heater_log_pending_heater = heater;
+  heater_log_pending_event = event;
+}
+
+static int heater_log_term(float term)
+{
+  return constrain(term, -32767, 32767);
+}
+
+// Store the state of all heaters after an update of manage_heater(), every HEATER_LOG_INTERVAL
+// and right away when a fault is pending
+static void heater_log_record()
+{
+  if (heater_log_frozen) return;
+  if (!heater_log_pending_event && heater_log_count > 0 && millis() - heater_log_last_ms < HEATER_LOG_INTERVAL) return;
+  heater_log_last_ms = millis();
+  heater_log_entry &entry = heater_log[heater_log_head];
+  entry.ms = heater_log_last_ms;
+  CRITICAL_SECTION_START;
+  entry.event = heater_log_pending_event;
+  entry.event_heater = heater_log_pending_heater;
+  heater_log_pending_event = 0;
+  CRITICAL_SECTION_END;
+
+  for (uint8_t h = 0; h <= EXTRUDERS; h++) {
+    heater_log_heater &hl = entry.heater[h];
+    hl.p = hl.i = hl.d = 0;
+    if (h < EXTRUDERS) {
+      hl.temp = current_temperature[h] * 10;
+      hl.target = target_temperature[h] * 10;
+      hl.pwm = soft_pwm[h];
+      #ifdef PIDTEMP
+        if (!pid_reset[h]) {
+          hl.p = heater_log_term(pTerm[h]);
+          hl.i = heater_log_term(iTerm[h]);
+          hl.d = heater_log_term(dTerm[h]);
+        }
+      #endif
+    }
+    else {
+      hl.temp = current_temperature_bed * 10;
+      hl.target = target_temperature_bed * 10;
+      hl.pwm = soft_pwm_bed;
+      #ifdef PIDTEMPBED
+        if (target_temperature_bed > 0) {
+          hl.p = heater_log_term(pTerm_bed);
+          hl.i = heater_log_term(iTerm_bed);
+          hl.d = heater_log_term(dTerm_bed);
+        }
+      #endif
+    }
+  }
+
+  if (++heater_log_head >= HEATER_LOG_SIZE) heater_log_head = 0;
+  if (heater_log_count < HEATER_LOG_SIZE) heater_log_count++;
+  if (entry.event) {
+    // The log only lives in RAM and a fault may end in a halt that takes no more commands, hand it out now
+    heater_log_frozen = true;
+    SERIAL_ERROR_START;
+    SERIAL_ERRORLNPGM(MSG_HEATER_LOG_FAULT);
+    heater_log_dump(false);
+    #ifdef SDSUPPORT
+      if (card.cardOK && !card.isFileOpen()) heater_log_dump(true);
+    #endif
+  }
+}
+
+void heater_log_clear()
+{
+  heater_log_head = 0;
+  heater_log_count = 0;
+  heater_log_pending_event = 0;
+  heater_log_frozen = false;
+}
+
+static char *heater_log_tenths(char *p, int v)
+{
+  return p + sprintf_P(p, PSTR(",%s%d.%d"), v < 0 ? "-" : "", abs(v) / 10, abs(v) % 10);
+}
+
+// Print the log oldest entry first as CSV, or write it to HEATLOG.CSV on the SD card.
+// Temperatures in degC, power 0..127 like M105, the columns repeat for each hotend and then the bed.
+void heater_log_dump(bool to_sd)
+{
+  #ifdef SDSUPPORT
+    if (to_sd) {
+      if (card.isFileOpen() || !card.cardOK) {
+        SERIAL_ERROR_START;
+        SERIAL_ERRORLNPGM(MSG_HEATER_LOG_SD_BUSY);
+        return;
+      }
+      card.openFile((char *)"heatlog.csv", false);
+      if (!card.isFileOpen()) return;
+    }
+  #else
+    to_sd = false;
+  #endif
+
+  char line[32 + 48 * (EXTRUDERS+1)]; // room for the \r\n write_command() appends
+  char *p = line + sprintf_P(line, PSTR("ms,event,heater"));
+  for (uint8_t h = 0; h <= EXTRUDERS; h++)
+    p += sprintf_P(p, PSTR(",temp%d,target%d,pwm%d,p%d,i%d,d%d"), h, h, h, h, h, h);
+  for (int n = -1; n < heater_log_count; n++) {
+    if (n >= 0) {
+      const heater_log_entry &entry = heater_log[(heater_log_head + HEATER_LOG_SIZE - heater_log_count + n) % HEATER_LOG_SIZE];
+      p = line + sprintf_P(line, PSTR("%lu,%d,%d"), entry.ms, entry.event, entry.event ? entry.event_heater : 0);
+      for (uint8_t h = 0; h <= EXTRUDERS; h++) {
+        const heater_log_heater &hl = entry.heater[h];
+        p = heater_log_tenths(p, hl.temp);
+        p = heater_log_tenths(p, hl.target);
+        p += sprintf_P(p, PSTR(",%d,%d,%d,%d"), hl.pwm, hl.p, hl.i, hl.d);
+      }
+    }
+    #ifdef SDSUPPORT
+      if (to_sd) {
+        card.write_command(line);
+        continue;
+      }
+    #endif
+    SERIAL_PROTOCOLLN(line);
+  }
+
+  #ifdef SDSUPPORT
+    if (to_sd) {
+      card.closefile();
+      SERIAL_PROTOCOLLNPGM(MSG_FILE_SAVED);
+    }
+  #endif
+}
+#endif //HEATER_EVENT_LOG
+
 void manage_heater()
 {
   float pid_input;
@@ -472,6 +868,10 @@ void manage_heater()
           #define K2 (1.0-K1)
           dTerm[e] = (Kd * (pid_input - temp_dState[e]))*K2 + (K1 * dTerm[e]);
           pid_output = pTerm[e] + iTerm[e] - dTerm[e];
+          #ifdef PID_ADD_EXTRUSION_RATE
+            // Feed forward the heat taken away by the filament already queued in the planner
+            pid_output += Kc * plan_extrusion_rate(e);
+          #endif
           if (pid_output > PID_MAX) {
             if (pid_error[e] > 0 )  temp_iState[e] -= pid_error[e]; // conditional un-integration
             pid_output=PID_MAX;
@@ -521,6 +921,9 @@ void manage_heater()
         if(degHotend(e) < watch_start_temp[e] + WATCH_TEMP_INCREASE)
         {
             setTargetHotend(0, e);
+            #ifdef HEATER_EVENT_LOG
+              heater_log_event(HEATER_LOG_HEATING_FAILED, e);
+            #endif
             LCD_MESSAGEPGM("Heating failed");
             SERIAL_ECHO_START;
             SERIAL_ECHOLN("Heating failed");
@@ -531,6 +934,9 @@ void manage_heater()
     #endif
     #ifdef TEMP_SENSOR_1_AS_REDUNDANT
       if(fabs(current_temperature[0] - redundant_temperature) > MAX_REDUNDANT_TEMP_SENSOR_DIFF) {
+        #ifdef HEATER_EVENT_LOG
+          heater_log_event(HEATER_LOG_REDUNDANT, 0);
+        #endif
         disable_heater();
         if(IsStopped() == false) {
           SERIAL_ERROR_START;
@@ -555,11 +961,25 @@ void manage_heater()
   #endif       
   
   #ifndef PIDTEMPBED
-  if(millis() - previous_millis_bed_heater < BED_CHECK_INTERVAL)
+  if(millis() - previous_millis_bed_heater < BED_CHECK_INTERVAL) {
+    #ifdef HEATER_POWER_BUDGET
+      apply_power_budget();
+    #endif
+    #ifdef HEATER_EVENT_LOG
+      heater_log_record();
+    #endif
+    #ifdef HEATER_HARDWARE_PWM
+      update_hardware_pwm();
+    #endif
     return;
+  }
   previous_millis_bed_heater = millis();
   #endif
 
+  #ifdef HEATER_POWER_BUDGET
+    soft_pwm_bed = soft_pwm_bed_request; // the bed control works on what it asked for last time
+  #endif
+
   #if TEMP_SENSOR_BED != 0
   
     #ifdef THERMAL_RUNAWAY_PROTECTION_BED_PERIOD && THERMAL_RUNAWAY_PROTECTION_BED_PERIOD > 0
@@ -618,7 +1038,7 @@ void manage_heater()
       else
       {
         soft_pwm_bed = 0;
-        WRITE(HEATER_BED_PIN,LOW);
+        WRITE_HEATER(HEATER_BED_PIN,LOW);
       }
     #else //#ifdef BED_LIMIT_SWITCHING
       // Check if temperature is within the correct band
@@ -636,31 +1056,21 @@ void manage_heater()
       else
       {
         soft_pwm_bed = 0;
-        WRITE(HEATER_BED_PIN,LOW);
+        WRITE_HEATER(HEATER_BED_PIN,LOW);
       }
     #endif
   #endif
   
-//code for controlling the extruder rate based on the width sensor 
-#ifdef FILAMENT_SENSOR
-  if(filament_sensor) 
-	{
-	meas_shift_index=delay_index1-meas_delay_cm;
-		  if(meas_shift_index<0)
-			  meas_shift_index = meas_shift_index + (MAX_MEASUREMENT_DELAY+1);  //loop around buffer if needed
-		  
-		  //get the delayed info and add 100 to reconstitute to a percent of the nominal filament diameter
-		  //then square it to get an area
-		  
-		  if(meas_shift_index<0)
-			  meas_shift_index=0;
-		  else if (meas_shift_index>MAX_MEASUREMENT_DELAY)
-			  meas_shift_index=MAX_MEASUREMENT_DELAY;
-		  
-		     volumetric_multiplier[FILAMENT_SENSOR_EXTRUDER_NUM] = pow((float)(100+measurement_delay[meas_shift_index])/100.0,2);
-		     if (volumetric_multiplier[FILAMENT_SENSOR_EXTRUDER_NUM] <0.01)
-		    	 volumetric_multiplier[FILAMENT_SENSOR_EXTRUDER_NUM]=0.01;
-	}
+  #ifdef HEATER_POWER_BUDGET
+    soft_pwm_bed_request = soft_pwm_bed;
+    apply_power_budget();
+  #endif
+
+#ifdef HEATER_EVENT_LOG
+  heater_log_record();
+#endif
+#ifdef HEATER_HARDWARE_PWM
+  update_hardware_pwm();
 #endif
 }
 
@@ -743,6 +1153,100 @@ static float analog2tempBed(int raw) {
   #endif
 }
 
+#ifdef THERMAL_SIMULATION
+// Inverse of the table lookup in analog2temp(): the raw value a sensor reads at the given temperature.
+static int sim_table_raw(short (*tt)[][2], uint8_t len, float celsius)
+{
+  uint8_t i;
+  for (i=1; i<len; i++)
+  {
+    short t0 = PGM_RD_W((*tt)[i-1][1]);
+    short t1 = PGM_RD_W((*tt)[i][1]);
+    if (t0 != t1 && (celsius - t0) * (celsius - t1) <= 0)
+    {
+      return PGM_RD_W((*tt)[i-1][0]) +
+        (celsius - t0) *
+        (float)(PGM_RD_W((*tt)[i][0]) - PGM_RD_W((*tt)[i-1][0])) /
+        (float)(t1 - t0);
+    }
+  }
+  // Off the table: the end closest in temperature
+  if (fabs(celsius - PGM_RD_W((*tt)[0][1])) < fabs(celsius - PGM_RD_W((*tt)[len-1][1])))
+    return PGM_RD_W((*tt)[0][0]);
+  return PGM_RD_W((*tt)[len-1][0]);
+}
+
+static int sim_temp2analog(float celsius, uint8_t e)
+{
+  #ifdef HEATER_0_USES_MAX6675
+    if (e == 0)
+      return celsius * 4;
+  #endif
+  if(heater_ttbl_map[e] != NULL)
+    return sim_table_raw((short (*)[][2])(heater_ttbl_map[e]), heater_ttbllen_map[e], celsius);
+  return (celsius - TEMP_SENSOR_AD595_OFFSET) / TEMP_SENSOR_AD595_GAIN * OVERSAMPLENR * (1024.0 / (5.0 * 100.0));
+}
+
+static int sim_temp2analogBed(float celsius)
+{
+  #ifdef BED_USES_THERMISTOR
+    return sim_table_raw((short (*)[][2])BEDTEMPTABLE, BEDTEMPTABLE_LEN, celsius);
+  #elif defined BED_USES_AD595
+    return (celsius - TEMP_SENSOR_AD595_OFFSET) / TEMP_SENSOR_AD595_GAIN * OVERSAMPLENR * (1024.0 / (5.0 * 100.0));
+  #else
+    return 0;
+  #endif
+}
+
+// One step of a heater: the block is heated by the heater and loses heat to the ambient,
+// the sensor follows the block with a lag.
+static void sim_heater_step(uint8_t h, float watts, float capacity, float loss, float lag, float dt)
+{
+  sim_block_temp[h] += (watts - (sim_block_temp[h] - SIM_AMBIENT_TEMP) * loss) * dt / capacity;
+  float k = dt / lag;
+  if (k > 1) k = 1;
+  sim_sensor_temp[h] += (sim_block_temp[h] - sim_sensor_temp[h]) * k;
+}
+
+// Advance the heater model to now and hand the readings of the simulated sensors to the temperature ISR
+static void thermal_sim_update()
+{
+  unsigned long ms = millis();
+  float dt = (ms - sim_previous_millis) / 1000.0;
+  sim_previous_millis = ms;
+
+  float fan_loss = SIM_HOTEND_FAN_LOSS * fanSpeed / 255.0;
+  int raw[EXTRUDERS+1];
+  for(uint8_t e=0;e<EXTRUDERS;e++)
+  {
+    // soft_pwm is on for soft_pwm out of 128 counts
+    sim_heater_step(e, SIM_HOTEND_WATTS * soft_pwm[e] / 128.0, SIM_HOTEND_HEAT_CAPACITY, SIM_HOTEND_LOSS + fan_loss, SIM_HOTEND_SENSOR_LAG, dt);
+    raw[e] = sim_temp2analog(sim_sensor_temp[e], e);
+  }
+  sim_heater_step(EXTRUDERS, SIM_BED_WATTS * soft_pwm_bed / 128.0, SIM_BED_HEAT_CAPACITY, SIM_BED_LOSS, SIM_BED_SENSOR_LAG, dt);
+  raw[EXTRUDERS] = sim_temp2analogBed(sim_sensor_temp[EXTRUDERS]);
+  #ifdef TEMP_SENSOR_1_AS_REDUNDANT
+    int redundant_raw = sim_temp2analog(sim_sensor_temp[0], 1);
+  #endif
+
+  CRITICAL_SECTION_START;
+  for(uint8_t h=0;h<=EXTRUDERS;h++)
+    sim_temp_raw[h] = raw[h];
+  #ifdef TEMP_SENSOR_1_AS_REDUNDANT
+    sim_redundant_raw = redundant_raw;
+  #endif
+  CRITICAL_SECTION_END;
+}
+
+static void thermal_sim_init()
+{
+  for(uint8_t h=0;h<=EXTRUDERS;h++)
+    sim_block_temp[h] = sim_sensor_temp[h] = SIM_AMBIENT_TEMP;
+  sim_previous_millis = millis();
+  thermal_sim_update();
+}
+#endif //THERMAL_SIMULATION
+
 /* Called to get the raw values into the the actual temperatures. The raw values are created in interrupt context,
     and this function is called from normal context as it is too slow to run in interrupts and will block the stepper routine otherwise */
 static void updateTemperaturesFromRawValues()
@@ -758,6 +1262,9 @@ static void updateTemperaturesFromRawValues()
     #if defined (FILAMENT_SENSOR) && (FILWIDTH_PIN > -1)    //check if a sensor is supported 
       filament_width_meas = analog2widthFil();
     #endif  
+    #ifdef THERMAL_SIMULATION
+      thermal_sim_update();
+    #endif
     //Reset the watchdog after we know we have a temperature measurement.
     watchdog_reset();
 
@@ -772,23 +1279,6 @@ static void updateTemperaturesFromRawValues()
 float analog2widthFil() { 
 return current_raw_filwidth/16383.0*5.0; 
 //return current_raw_filwidth; 
-} 
- 
-// For converting raw Filament Width to a ratio 
-int widthFil_to_size_ratio() { 
- 
-float temp; 
-      
-temp=filament_width_meas;
-if(filament_width_meas<MEASURED_LOWER_LIMIT)
-	temp=filament_width_nominal;  //assume sensor cut out
-else if (filament_width_meas>MEASURED_UPPER_LIMIT)
-	temp= MEASURED_UPPER_LIMIT;
-
-
-return(filament_width_nominal/temp*100); 
-
-
 } 
 #endif
 
@@ -830,6 +1320,14 @@ void tp_init()
   #if defined(HEATER_BED_PIN) && (HEATER_BED_PIN > -1) 
     SET_OUTPUT(HEATER_BED_PIN);
   #endif  
+  // With THERMAL_SIMULATION every heater stays on the soft PWM, which holds the pins low
+  #if defined(HEATER_HARDWARE_PWM) && !defined(THERMAL_SIMULATION)
+    for (uint8_t h = 0; h <= EXTRUDERS; h++)
+      if (pin_has_free_pwm(heater_pin(h))) hardware_pwm_heaters |= 1 << h;
+    #ifdef HEATERS_PARALLEL
+      if (!pin_has_free_pwm(HEATER_1_PIN)) hardware_pwm_heaters &= ~1;
+    #endif
+  #endif
   #if defined(FAN_PIN) && (FAN_PIN > -1) 
     SET_OUTPUT(FAN_PIN);
     #ifdef FAST_PWM_FAN
@@ -906,6 +1404,16 @@ void tp_init()
    #endif
   #endif
   
+  #ifdef ADC_FREE_RUNNING
+    adc_engine_init();
+  #endif
+
+  #ifdef THERMAL_SIMULATION
+    thermal_sim_init();
+    SERIAL_ECHO_START;
+    SERIAL_ECHOLNPGM(MSG_THERMAL_SIMULATION);
+  #endif
+
   // Use timer0 for temperature measurement
   // Interleave temperature interrupt with millies interrupt
   OCR0B = 128;
@@ -1058,6 +1566,10 @@ void thermal_runaway_protection(int *state, unsigned long *timer, float temperat
         else
           SERIAL_ERRORLN((int)heater_id);
         LCD_ALERTMESSAGEPGM("THERMAL RUNAWAY");
+        #ifdef HEATER_EVENT_LOG
+          heater_log_event(HEATER_LOG_RUNAWAY, (heater_id == 9) ? EXTRUDERS : heater_id);
+          heater_log_record(); // freezes and dumps the log before the halt
+        #endif
         thermal_runaway = true;
         while(1)
         {
@@ -1086,7 +1598,7 @@ void disable_heater()
   target_temperature[0]=0;
   soft_pwm[0]=0;
    #if defined(HEATER_0_PIN) && HEATER_0_PIN > -1  
-     WRITE(HEATER_0_PIN,LOW);
+     WRITE_HEATER(HEATER_0_PIN,LOW);
    #endif
   #endif
      
@@ -1094,7 +1606,7 @@ void disable_heater()
     target_temperature[1]=0;
     soft_pwm[1]=0;
     #if defined(HEATER_1_PIN) && HEATER_1_PIN > -1 
-      WRITE(HEATER_1_PIN,LOW);
+      WRITE_HEATER(HEATER_1_PIN,LOW);
     #endif
   #endif
       
@@ -1102,20 +1614,30 @@ void disable_heater()
     target_temperature[2]=0;
     soft_pwm[2]=0;
     #if defined(HEATER_2_PIN) && HEATER_2_PIN > -1  
-      WRITE(HEATER_2_PIN,LOW);
+      WRITE_HEATER(HEATER_2_PIN,LOW);
     #endif
   #endif 
 
   #if defined(TEMP_BED_PIN) && TEMP_BED_PIN > -1
     target_temperature_bed=0;
     soft_pwm_bed=0;
+    #ifdef HEATER_POWER_BUDGET
+      soft_pwm_bed_request=0;
+    #endif
     #if defined(HEATER_BED_PIN) && HEATER_BED_PIN > -1  
-      WRITE(HEATER_BED_PIN,LOW);
+      WRITE_HEATER(HEATER_BED_PIN,LOW);
     #endif
   #endif 
+
+  #ifdef HEATER_HARDWARE_PWM
+    update_hardware_pwm();
+  #endif
 }
 
 void max_temp_error(uint8_t e) {
+  #ifdef HEATER_EVENT_LOG
+    heater_log_event(HEATER_LOG_MAXTEMP, e);
+  #endif
   disable_heater();
   if(IsStopped() == false) {
     SERIAL_ERROR_START;
@@ -1129,6 +1651,9 @@ void max_temp_error(uint8_t e) {
 }
 
 void min_temp_error(uint8_t e) {
+  #ifdef HEATER_EVENT_LOG
+    heater_log_event(HEATER_LOG_MINTEMP, e);
+  #endif
   disable_heater();
   if(IsStopped() == false) {
     SERIAL_ERROR_START;
@@ -1142,8 +1667,15 @@ void min_temp_error(uint8_t e) {
 }
 
 void bed_max_temp_error(void) {
+#ifdef HEATER_EVENT_LOG
+  heater_log_event(HEATER_LOG_MAXTEMP, EXTRUDERS);
+#endif
 #if HEATER_BED_PIN > -1
-  WRITE(HEATER_BED_PIN, 0);
+  WRITE_HEATER(HEATER_BED_PIN, 0);
+#endif
+#ifdef HEATER_HARDWARE_PWM
+  soft_pwm_bed = 0;
+  update_hardware_pwm();
 #endif
   if(IsStopped() == false) {
     SERIAL_ERROR_START;
@@ -1211,10 +1743,130 @@ int read_max6675()
 }
 #endif
 
+#ifdef ADC_FREE_RUNNING
+// Inputs of the ADC engine, a pin of -1 leaves the slot out of the rotation
+#if defined(TEMP_0_PIN) && (TEMP_0_PIN > -1)
+  #define ADC_PIN_0 TEMP_0_PIN
+#else
+  #define ADC_PIN_0 -1
+#endif
+#if defined(TEMP_1_PIN) && (TEMP_1_PIN > -1) && ((EXTRUDERS > 1) || defined(TEMP_SENSOR_1_AS_REDUNDANT))
+  #define ADC_PIN_1 TEMP_1_PIN
+#else
+  #define ADC_PIN_1 -1
+#endif
+#if defined(TEMP_2_PIN) && (TEMP_2_PIN > -1) && (EXTRUDERS > 2)
+  #define ADC_PIN_2 TEMP_2_PIN
+#else
+  #define ADC_PIN_2 -1
+#endif
+#if defined(TEMP_BED_PIN) && (TEMP_BED_PIN > -1)
+  #define ADC_PIN_BED TEMP_BED_PIN
+#else
+  #define ADC_PIN_BED -1
+#endif
+#if defined(FILAMENT_SENSOR) && defined(FILWIDTH_PIN) && (FILWIDTH_PIN > -1)
+  #define ADC_PIN_FILWIDTH FILWIDTH_PIN
+#else
+  #define ADC_PIN_FILWIDTH -1
+#endif
+
+#define ADC_SLOTS 5
+#define ADC_SLOT_BED 3
+#define ADC_SLOT_FILWIDTH 4
+
+static const signed char adc_slot_pin[ADC_SLOTS] = { ADC_PIN_0, ADC_PIN_1, ADC_PIN_2, ADC_PIN_BED, ADC_PIN_FILWIDTH };
+static const unsigned char adc_slot_filter[ADC_SLOTS] = { ADC_FILTER_HOTEND, ADC_FILTER_HOTEND, ADC_FILTER_HOTEND, ADC_FILTER_BED, ADC_FILTER_FILWIDTH };
+
+static volatile unsigned int adc_value[ADC_SLOTS]; // newest filtered sum of OVERSAMPLENR conversions of each slot
+static volatile bool adc_values_ready = false;      // set once every slot has a value
+static unsigned int adc_sum[ADC_SLOTS];
+static unsigned int adc_history[ADC_SLOTS][2];      // previous two sums for the median filter
+static unsigned long adc_iir[ADC_SLOTS];            // low pass state, scaled by 2^ADC_IIR_SHIFT
+static unsigned char adc_slot;                      // slot being converted
+static unsigned char adc_round = 0;                 // conversions of every slot summed so far
+
+static void adc_start_conversion(unsigned char slot)
+{
+  signed char pin = adc_slot_pin[slot];
+  #ifdef MUX5
+    ADCSRB = (pin > 7) ? 1<<MUX5 : 0;
+  #else
+    ADCSRB = 0;
+  #endif
+  ADMUX = ((1 << REFS0) | (pin & 0x07));
+  ADCSRA |= 1<<ADSC; // Start conversion
+}
+
+static unsigned char adc_next_slot(unsigned char slot)
+{
+  do {
+    if (++slot >= ADC_SLOTS) slot = 0;
+  } while (adc_slot_pin[slot] < 0);
+  return slot;
+}
+
+static unsigned int adc_filter(unsigned char slot, unsigned int sum)
+{
+  if (!adc_values_ready) {
+    // First sum, start the filters from it instead of zero so MINTEMP does not trip
+    adc_history[slot][0] = adc_history[slot][1] = sum;
+    adc_iir[slot] = (unsigned long)sum << ADC_IIR_SHIFT;
+    return sum;
+  }
+  switch (adc_slot_filter[slot]) {
+    case 1: {
+      unsigned int a = adc_history[slot][0], b = adc_history[slot][1];
+      adc_history[slot][0] = b;
+      adc_history[slot][1] = sum;
+      unsigned int lo = min(a, b), hi = max(a, b);
+      return max(lo, min(hi, sum));
+    }
+    case 2:
+      adc_iir[slot] -= adc_iir[slot] >> ADC_IIR_SHIFT;
+      adc_iir[slot] += sum;
+      return adc_iir[slot] >> ADC_IIR_SHIFT;
+    default:
+      return sum;
+  }
+}
+
+// Conversion complete: add it to the sum of its slot and start the next one right away
+ISR(ADC_vect)
+{
+  PROFILE_TIMER0_START;
+  adc_sum[adc_slot] += ADC;
+  unsigned char next = adc_next_slot(adc_slot);
+  if (next <= adc_slot && ++adc_round >= OVERSAMPLENR) {
+    for (unsigned char slot = 0; slot < ADC_SLOTS; slot++) {
+      if (adc_slot_pin[slot] < 0) continue;
+      adc_value[slot] = adc_filter(slot, adc_sum[slot]);
+      adc_sum[slot] = 0;
+    }
+    adc_round = 0;
+    adc_values_ready = true;
+  }
+  adc_slot = next;
+  adc_start_conversion(adc_slot);
+  PROFILE_TIMER0_END(PROFILE_ADC);
+}
+
+static void adc_engine_init()
+{
+  unsigned char slot;
+  for (slot = 0; slot < ADC_SLOTS && adc_slot_pin[slot] < 0; slot++) ;
+  if (slot >= ADC_SLOTS) return; // nothing to convert
+  while (ADCSRA & (1<<ADSC)) ; // let the conversion started by tp_init() finish
+  adc_slot = slot;
+  ADCSRA |= 1<<ADIF | 1<<ADIE;
+  adc_start_conversion(adc_slot);
+}
+#endif //ADC_FREE_RUNNING
 
 // Timer 0 is shared with millies
 ISR(TIMER0_COMPB_vect)
 {
+  PROFILE_TEMPERATURE_START;
   //these variables are only accesible from the ISR, but static, so they don't lose their value
   static unsigned char temp_count = 0;
   static unsigned long raw_temp_0_value = 0;
@@ -1261,44 +1913,52 @@ ISR(TIMER0_COMPB_vect)
    */
   if(pwm_count == 0){
     soft_pwm_0 = soft_pwm[0];
-    if(soft_pwm_0 > 0) { 
-      WRITE(HEATER_0_PIN,1);
+    if(SOFT_PWM_HEATER(0)) {
+      if(soft_pwm_0 > 0) { 
+        WRITE_HEATER(HEATER_0_PIN,1);
 #ifdef HEATERS_PARALLEL
-      WRITE(HEATER_1_PIN,1);
+        WRITE_HEATER(HEATER_1_PIN,1);
 #endif
-    } else WRITE(HEATER_0_PIN,0);
+      } else WRITE_HEATER(HEATER_0_PIN,0);
+    }
     
 #if EXTRUDERS > 1
     soft_pwm_1 = soft_pwm[1];
-    if(soft_pwm_1 > 0) WRITE(HEATER_1_PIN,1); else WRITE(HEATER_1_PIN,0);
+    if(SOFT_PWM_HEATER(1)) {
+      if(soft_pwm_1 > 0) WRITE_HEATER(HEATER_1_PIN,1); else WRITE_HEATER(HEATER_1_PIN,0);
+    }
 #endif
 #if EXTRUDERS > 2
     soft_pwm_2 = soft_pwm[2];
-    if(soft_pwm_2 > 0) WRITE(HEATER_2_PIN,1); else WRITE(HEATER_2_PIN,0);
+    if(SOFT_PWM_HEATER(2)) {
+      if(soft_pwm_2 > 0) WRITE_HEATER(HEATER_2_PIN,1); else WRITE_HEATER(HEATER_2_PIN,0);
+    }
 #endif
 #if defined(HEATER_BED_PIN) && HEATER_BED_PIN > -1
     soft_pwm_b = soft_pwm_bed;
-    if(soft_pwm_b > 0) WRITE(HEATER_BED_PIN,1); else WRITE(HEATER_BED_PIN,0);
+    if(SOFT_PWM_HEATER(EXTRUDERS)) {
+      if(soft_pwm_b > 0) WRITE_HEATER(HEATER_BED_PIN,1); else WRITE_HEATER(HEATER_BED_PIN,0);
+    }
 #endif
 #ifdef FAN_SOFT_PWM
     soft_pwm_fan = fanSpeedSoftPwm / 2;
     if(soft_pwm_fan > 0) WRITE(FAN_PIN,1); else WRITE(FAN_PIN,0);
 #endif
   }
-  if(soft_pwm_0 < pwm_count) { 
-    WRITE(HEATER_0_PIN,0);
+  if(soft_pwm_0 < pwm_count && SOFT_PWM_HEATER(0)) { 
+    WRITE_HEATER(HEATER_0_PIN,0);
 #ifdef HEATERS_PARALLEL
-    WRITE(HEATER_1_PIN,0);
+    WRITE_HEATER(HEATER_1_PIN,0);
 #endif
   }
 #if EXTRUDERS > 1
-  if(soft_pwm_1 < pwm_count) WRITE(HEATER_1_PIN,0);
+  if(soft_pwm_1 < pwm_count && SOFT_PWM_HEATER(1)) WRITE_HEATER(HEATER_1_PIN,0);
 #endif
 #if EXTRUDERS > 2
-  if(soft_pwm_2 < pwm_count) WRITE(HEATER_2_PIN,0);
+  if(soft_pwm_2 < pwm_count && SOFT_PWM_HEATER(2)) WRITE_HEATER(HEATER_2_PIN,0);
 #endif
 #if defined(HEATER_BED_PIN) && HEATER_BED_PIN > -1
-  if(soft_pwm_b < pwm_count) WRITE(HEATER_BED_PIN,0);
+  if(soft_pwm_b < pwm_count && SOFT_PWM_HEATER(EXTRUDERS)) WRITE_HEATER(HEATER_BED_PIN,0);
 #endif
 #ifdef FAN_SOFT_PWM
   if(soft_pwm_fan < pwm_count) WRITE(FAN_PIN,0);
@@ -1327,9 +1987,9 @@ ISR(TIMER0_COMPB_vect)
 	  state_timer_heater_0 = MIN_STATE_TIME;
 	}
 	state_heater_0 = 1;
-	WRITE(HEATER_0_PIN, 1);
+	WRITE_HEATER(HEATER_0_PIN, 1);
 #ifdef HEATERS_PARALLEL
-	WRITE(HEATER_1_PIN, 1);
+	WRITE_HEATER(HEATER_1_PIN, 1);
 #endif
       }
     } else {
@@ -1340,9 +2000,9 @@ ISR(TIMER0_COMPB_vect)
 	  state_timer_heater_0 = MIN_STATE_TIME;
 	}
 	state_heater_0 = 0;
-	WRITE(HEATER_0_PIN, 0);
+	WRITE_HEATER(HEATER_0_PIN, 0);
 #ifdef HEATERS_PARALLEL
-	WRITE(HEATER_1_PIN, 0);
+	WRITE_HEATER(HEATER_1_PIN, 0);
 #endif
       }
     }
@@ -1358,7 +2018,7 @@ ISR(TIMER0_COMPB_vect)
 	  state_timer_heater_1 = MIN_STATE_TIME;
 	}
 	state_heater_1 = 1;
-	WRITE(HEATER_1_PIN, 1);
+	WRITE_HEATER(HEATER_1_PIN, 1);
       }
     } else {
       // turn OFF heather only if the minimum time is up 
@@ -1368,7 +2028,7 @@ ISR(TIMER0_COMPB_vect)
 	  state_timer_heater_1 = MIN_STATE_TIME;
 	}
 	state_heater_1 = 0;
-	WRITE(HEATER_1_PIN, 0);
+	WRITE_HEATER(HEATER_1_PIN, 0);
       }
     }
 #endif
@@ -1384,7 +2044,7 @@ ISR(TIMER0_COMPB_vect)
 	  state_timer_heater_2 = MIN_STATE_TIME;
 	}
 	state_heater_2 = 1;
-	WRITE(HEATER_2_PIN, 1);
+	WRITE_HEATER(HEATER_2_PIN, 1);
       }
     } else {
       // turn OFF heather only if the minimum time is up 
@@ -1394,7 +2054,7 @@ ISR(TIMER0_COMPB_vect)
 	  state_timer_heater_2 = MIN_STATE_TIME;
 	}
 	state_heater_2 = 0;
-	WRITE(HEATER_2_PIN, 0);
+	WRITE_HEATER(HEATER_2_PIN, 0);
       }
     }
 #endif
@@ -1410,7 +2070,7 @@ ISR(TIMER0_COMPB_vect)
 	  state_timer_heater_b = MIN_STATE_TIME;
 	}
 	state_heater_b = 1;
-	WRITE(HEATER_BED_PIN, 1);
+	WRITE_HEATER(HEATER_BED_PIN, 1);
       }
     } else {
       // turn OFF heather only if the minimum time is up 
@@ -1420,7 +2080,7 @@ ISR(TIMER0_COMPB_vect)
 	  state_timer_heater_b = MIN_STATE_TIME;
 	}
 	state_heater_b = 0;
-	WRITE(HEATER_BED_PIN, 0);
+	WRITE_HEATER(HEATER_BED_PIN, 0);
       }
     }
 #endif
@@ -1435,9 +2095,9 @@ ISR(TIMER0_COMPB_vect)
 	state_timer_heater_0 = MIN_STATE_TIME;
       }
       state_heater_0 = 0;
-      WRITE(HEATER_0_PIN, 0);
+      WRITE_HEATER(HEATER_0_PIN, 0);
 #ifdef HEATERS_PARALLEL
-      WRITE(HEATER_1_PIN, 0);
+      WRITE_HEATER(HEATER_1_PIN, 0);
 #endif
     }
   }
@@ -1452,7 +2112,7 @@ ISR(TIMER0_COMPB_vect)
 	state_timer_heater_1 = MIN_STATE_TIME;
       }
       state_heater_1 = 0;
-      WRITE(HEATER_1_PIN, 0);
+      WRITE_HEATER(HEATER_1_PIN, 0);
     }
   }
 #endif
@@ -1467,7 +2127,7 @@ ISR(TIMER0_COMPB_vect)
 	state_timer_heater_2 = MIN_STATE_TIME;
       }
       state_heater_2 = 0;
-      WRITE(HEATER_2_PIN, 0);
+      WRITE_HEATER(HEATER_2_PIN, 0);
     }
   }
 #endif
@@ -1482,7 +2142,7 @@ ISR(TIMER0_COMPB_vect)
 	state_timer_heater_b = MIN_STATE_TIME;
       }
       state_heater_b = 0;
-      WRITE(HEATER_BED_PIN, 0);
+      WRITE_HEATER(HEATER_BED_PIN, 0);
     }
   }
 #endif
@@ -1529,6 +2189,23 @@ ISR(TIMER0_COMPB_vect)
   
 #endif //ifndef SLOW_PWM_HEATERS
   
+#ifdef ADC_FREE_RUNNING
+  // The ADC engine converts on its own, here the newest values are only handed over at a fixed rate
+  // with a counter of its own, temp_count of the state machine is not used
+  static unsigned char adc_publish_count = 0;
+  bool adc_publish = false;
+  if ((temp_state ^= 1) & 1) lcd_buttons_update(); // every other tick, like the state machine
+  if (++adc_publish_count >= ADC_PUBLISH_TICKS) {
+    adc_publish_count = 0;
+    if (adc_values_ready) {
+      raw_temp_0_value = adc_value[0];
+      raw_temp_1_value = adc_value[1];
+      raw_temp_2_value = adc_value[2];
+      raw_temp_bed_value = adc_value[ADC_SLOT_BED];
+      adc_publish = true;
+    }
+  }
+#else
   switch(temp_state) {
     case 0: // Prepare TEMP_0
       #if defined(TEMP_0_PIN) && (TEMP_0_PIN > -1)
@@ -1647,9 +2324,27 @@ ISR(TIMER0_COMPB_vect)
 //      SERIAL_ERRORLNPGM("Temp measurement error!");
 //      break;
   }
+#endif //ADC_FREE_RUNNING
     
+#ifdef ADC_FREE_RUNNING
+  if(adc_publish) // every ADC_PUBLISH_TICKS
+#else
   if(temp_count >= OVERSAMPLENR) // 10 * 16 * 1/(16000000/64/256)  = 164ms.
+#endif
   {
+#ifdef THERMAL_SIMULATION
+    // Replace the conversions by the readings of the heater model
+    raw_temp_0_value = sim_temp_raw[0];
+  #if EXTRUDERS > 1
+    raw_temp_1_value = sim_temp_raw[1];
+  #elif defined(TEMP_SENSOR_1_AS_REDUNDANT)
+    raw_temp_1_value = sim_redundant_raw;
+  #endif
+  #if EXTRUDERS > 2
+    raw_temp_2_value = sim_temp_raw[2];
+  #endif
+    raw_temp_bed_value = sim_temp_raw[EXTRUDERS];
+#endif
     if (!temp_meas_ready) //Only update the raw values if they have been read. Else we could be updating them during reading.
     {
       current_temperature_raw[0] = raw_temp_0_value;
@@ -1667,7 +2362,12 @@ ISR(TIMER0_COMPB_vect)
 
 //Add similar code for Filament Sensor - can be read any time since IIR filtering is used 
 #if defined(FILWIDTH_PIN) &&(FILWIDTH_PIN > -1)
+  #ifdef ADC_FREE_RUNNING
+  if (adc_value[ADC_SLOT_FILWIDTH] > 102 * OVERSAMPLENR) // only take in readings above 0.5 volts, the engine filters already
+    current_raw_filwidth = adc_value[ADC_SLOT_FILWIDTH];
+  #else
   current_raw_filwidth = raw_filwidth_value>>10;  //need to divide to get to 0-16384 range since we used 1/128 IIR filter approach 
+  #endif
 #endif
     
     
@@ -1756,6 +2456,7 @@ ISR(TIMER0_COMPB_vect)
     }
   }
 #endif //BABYSTEPPING
+  PROFILE_TIMER0_END(PROFILE_TEMPERATURE);
 }
 
 #ifdef PIDTEMP
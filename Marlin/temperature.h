@@ -34,9 +34,6 @@ void manage_heater(); //it is critical that this is called periodically.
 #ifdef FILAMENT_SENSOR
 // For converting raw Filament Width to milimeters 
  float analog2widthFil(); 
- 
-// For converting raw Filament Width to an extrusion ratio 
- int widthFil_to_size_ratio();
 #endif
 
 // low level conversion routines
@@ -73,6 +70,18 @@ extern float current_temperature_bed;
 #ifdef BABYSTEPPING
   extern volatile int babystepsTodo[3];
 #endif
+
+#ifdef HEATER_EVENT_LOG
+  // Faults in the event column of the heater log
+  #define HEATER_LOG_MAXTEMP 1
+  #define HEATER_LOG_MINTEMP 2
+  #define HEATER_LOG_RUNAWAY 3
+  #define HEATER_LOG_HEATING_FAILED 4
+  #define HEATER_LOG_REDUNDANT 5
+
+  void heater_log_dump(bool to_sd); // print the log, or write it to HEATLOG.CSV on the SD card
+  void heater_log_clear();          // empty the log and record again after a fault
+#endif
   
 //high level conversion routines, for use outside of temperature.cpp
 //inline so that there is no performance decrease.
@@ -184,7 +193,11 @@ FORCE_INLINE void autotempShutdown(){
  #endif
 }
 
-void PID_autotune(float temp, int extruder, int ncycles);
+// Tuning rules for PID_autotune()
+#define PID_TUNE_ZIEGLER_NICHOLS 0
+#define PID_TUNE_TYREUS_LUYBEN 1
+
+void PID_autotune(float temp, float bed_temp, uint8_t heaters, int ncycles, uint8_t rule, bool apply);
 
 void setExtruderAutoFanState(int pin, bool state);
 void checkExtruderAutoFans();
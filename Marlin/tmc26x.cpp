@@ -0,0 +1,160 @@
+#include "Marlin.h"
+#include "tmc26x.h"
+
+#ifdef HAVE_TMC26X
+#include <SPI.h>
+#include <TMC26XStepper.h>
+#include "scheduler.h"
+#include "language.h"
+
+#define TMC26X_DRIVERS 4 // X, Y, Z, E0
+
+static const int tmc_cs_pins[TMC26X_DRIVERS] = TMC26X_CS_PINS;
+static const unsigned int tmc_current[TMC26X_DRIVERS] = TMC26X_CURRENT;
+static const char tmc_stallguard_threshold[TMC26X_DRIVERS] = TMC26X_STALLGUARD_THRESHOLD;
+static const char tmc_axis_codes[TMC26X_DRIVERS] = {'X', 'Y', 'Z', 'E'};
+
+static TMC26XStepper tmc_drivers[TMC26X_DRIVERS] = {
+  TMC26XStepper(TMC26X_MOTOR_STEPS, tmc_cs_pins[0], X_DIR_PIN, X_STEP_PIN, tmc_current[0], TMC26X_SENSE_RESISTOR),
+  TMC26XStepper(TMC26X_MOTOR_STEPS, tmc_cs_pins[1], Y_DIR_PIN, Y_STEP_PIN, tmc_current[1], TMC26X_SENSE_RESISTOR),
+  TMC26XStepper(TMC26X_MOTOR_STEPS, tmc_cs_pins[2], Z_DIR_PIN, Z_STEP_PIN, tmc_current[2], TMC26X_SENSE_RESISTOR),
+  TMC26XStepper(TMC26X_MOTOR_STEPS, tmc_cs_pins[3], E0_DIR_PIN, E0_STEP_PIN, tmc_current[3], TMC26X_SENSE_RESISTOR)
+};
+
+static unsigned long tmc_status_time = 0;
+static uint8_t tmc_status_driver = 0;             // the driver whose status is checked next
+static uint8_t tmc_errors[TMC26X_DRIVERS];        // TMC_ERROR_* bits already reported
+
+#define TMC_ERROR_OVER_TEMPERATURE 1
+#define TMC_ERROR_SHORT            2
+#define TMC_ERROR_OPEN_LOAD        4
+
+#ifdef TMC26X_STALLGUARD_HOMING
+static const bool tmc_stall_homing_axes[3] = TMC26X_STALLGUARD_HOMING;
+static uint8_t tmc_homing_axes = 0;
+#endif
+
+// The SD card leaves the SPI bus at its own clock rate, the drivers get F_CPU / 8
+static uint8_t tmc_spcr, tmc_spsr;
+
+static void tmc_spi_begin()
+{
+  tmc_spcr = SPCR;
+  tmc_spsr = SPSR;
+  SPI.setBitOrder(MSBFIRST);
+  SPI.setClockDivider(SPI_CLOCK_DIV8);
+}
+
+static void tmc_spi_end()
+{
+  SPCR = tmc_spcr;
+  SPSR = tmc_spsr;
+}
+
+static bool tmc_present(uint8_t driver)
+{
+  return tmc_cs_pins[driver] > -1;
+}
+
+static void tmc_report(uint8_t driver, const char *message)
+{
+  SERIAL_ECHOPGM("TMC26X ");
+  SERIAL_ECHO(tmc_axis_codes[driver]);
+  SERIAL_ECHOPGM(": ");
+  serialprintPGM(message);
+  SERIAL_ECHOLN("");
+}
+
+// Report the error flags of a driver when they come up
+static void tmc_check_status(uint8_t driver)
+{
+  TMC26XStepper &tmc = tmc_drivers[driver];
+  tmc_spi_begin();
+  tmc.readStatus(TMC26X_READOUT_STALLGUARD);
+  tmc_spi_end();
+
+  uint8_t errors = 0;
+  char temperature = tmc.getOverTemperature();
+  if (temperature) errors |= TMC_ERROR_OVER_TEMPERATURE;
+  if (tmc.isShortToGroundA() || tmc.isShortToGroundB()) errors |= TMC_ERROR_SHORT;
+  // The open load flags are only valid while the motor turns
+  if (!tmc.isStandStill() && (tmc.isOpenLoadA() || tmc.isOpenLoadB())) errors |= TMC_ERROR_OPEN_LOAD;
+
+  uint8_t new_errors = errors & ~tmc_errors[driver];
+  tmc_errors[driver] = errors;
+  if (!new_errors) return;
+
+  if (temperature == TMC26X_OVERTEMPERATURE_SHUTDOWN || (new_errors & TMC_ERROR_SHORT))
+  {
+    // The driver switched its outputs off, the position is lost
+    SERIAL_ERROR_START;
+    tmc_report(driver, (new_errors & TMC_ERROR_SHORT) ? PSTR(MSG_TMC26X_SHORT) : PSTR(MSG_TMC26X_OVER_TEMPERATURE));
+    Stop();
+    return;
+  }
+  SERIAL_ECHO_START;
+  if (new_errors & TMC_ERROR_OVER_TEMPERATURE) tmc_report(driver, PSTR(MSG_TMC26X_TEMPERATURE_WARNING));
+  if (new_errors & TMC_ERROR_OPEN_LOAD) tmc_report(driver, PSTR(MSG_TMC26X_OPEN_LOAD));
+}
+
+// Scheduler task, one driver per TMC26X_STATUS_INTERVAL is checked so a pass never waits for
+// more than one SPI transfer
+static void tmc26x_task()
+{
+  if (millis() - tmc_status_time < TMC26X_STATUS_INTERVAL / TMC26X_DRIVERS) return;
+  tmc_status_time = millis();
+  if (tmc_present(tmc_status_driver)) tmc_check_status(tmc_status_driver);
+  tmc_status_driver = (tmc_status_driver + 1) % TMC26X_DRIVERS;
+}
+
+static void tmc_set_coolstep(uint8_t driver, bool enabled)
+{
+  #ifdef TMC26X_COOLSTEP
+    tmc_spi_begin();
+    tmc_drivers[driver].setCoolStepEnabled(enabled);
+    tmc_spi_end();
+  #endif
+}
+
+void tmc26x_init()
+{
+  const uint8_t microstep_modes[] = MICROSTEP_MODES;
+  for (uint8_t i = 0; i < TMC26X_DRIVERS; i++)
+  {
+    if (!tmc_present(i)) continue;
+    TMC26XStepper &tmc = tmc_drivers[i];
+    tmc.setMicrosteps(microstep_modes[i]);
+    tmc.setStallGuardThreshold(tmc_stallguard_threshold[i], 1);
+    #ifdef TMC26X_COOLSTEP
+      tmc.setCoolStepConfiguration(TMC26X_COOLSTEP_LOWER_SG, TMC26X_COOLSTEP_SG_HYSTERESIS, 0, 1, TMC26X_COOLSTEP_MIN_CURRENT);
+      tmc.setCoolStepEnabled(true);
+    #endif
+    tmc_spi_begin();
+    tmc.start(); // sends the whole configuration
+    tmc_spi_end();
+  }
+  scheduler_add(tmc26x_task, PSTR("tmc26x"), 0, 0, 2);
+}
+
+void tmc26x_homing(uint8_t axis_mask)
+{
+  #ifdef TMC26X_STALLGUARD_HOMING
+    for (uint8_t axis = X_AXIS; axis <= Z_AXIS; axis++)
+      if (!tmc26x_stall_homing(axis)) axis_mask &= ~(1 << axis);
+    // CoolStep changes the current and with it the StallGuard readings, keep it off while homing
+    for (uint8_t axis = X_AXIS; axis <= Z_AXIS; axis++)
+      if ((axis_mask | tmc_homing_axes) & (1 << axis)) tmc_set_coolstep(axis, !(axis_mask & (1 << axis)));
+    tmc_homing_axes = axis_mask;
+  #endif
+}
+
+bool tmc26x_stall_homing(uint8_t axis)
+{
+  #ifdef TMC26X_STALLGUARD_HOMING
+    return axis <= Z_AXIS && tmc_present(axis) && tmc_stall_homing_axes[axis];
+  #else
+    return false;
+  #endif
+}
+
+#endif //HAVE_TMC26X
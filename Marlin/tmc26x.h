@@ -0,0 +1,29 @@
+#ifndef TMC26X_H
+#define TMC26X_H
+
+#include "Marlin.h"
+
+#ifdef HAVE_TMC26X
+
+// TMC26X stepper drivers on the SPI bus. The step and direction pins are driven by the stepper
+// interrupt as with any driver. The drivers are configured once by st_init() and a scheduler task
+// checks their status. StallGuard homing reads the SG_TST output of a driver on its endstop pin.
+
+// Configure the drivers, called from st_init()
+void tmc26x_init();
+
+// The axes in axis_mask are homed from now on, 0 when homing is done. CoolStep is off on the
+// axes homed with StallGuard meanwhile.
+void tmc26x_homing(uint8_t axis_mask);
+
+// axis (X, Y or Z) is homed with StallGuard. It stops at the frame, so there is no retract and bump.
+bool tmc26x_stall_homing(uint8_t axis);
+
+#else
+
+FORCE_INLINE void tmc26x_homing(uint8_t axis_mask) {}
+FORCE_INLINE bool tmc26x_stall_homing(uint8_t axis) { return false; }
+
+#endif //HAVE_TMC26X
+
+#endif //TMC26X_H
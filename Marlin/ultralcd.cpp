@@ -797,7 +797,7 @@ static void lcd_control_temperature_menu()
     MENU_ITEM_EDIT_CALLBACK(float52, MSG_PID_I, &raw_Ki, 0.01, 9990, copy_and_scalePID_i);
     MENU_ITEM_EDIT_CALLBACK(float52, MSG_PID_D, &raw_Kd, 1, 9990, copy_and_scalePID_d);
 # ifdef PID_ADD_EXTRUSION_RATE
-    MENU_ITEM_EDIT(float3, MSG_PID_C, &Kc, 1, 9990);
+    MENU_ITEM_EDIT(float3, MSG_PID_C, &Kc, 0, 9990);
 # endif//PID_ADD_EXTRUSION_RATE
 #endif//PIDTEMP
     MENU_ITEM(submenu, MSG_PREHEAT_PLA_SETTINGS, lcd_control_temperature_preheat_pla_settings_menu);
@@ -1175,6 +1175,61 @@ void lcd_init()
 #endif
 }
 
+#ifdef LCD_RENDER_STATS
+lcd_render_stats_t lcd_render_stats;
+
+static void lcd_render_stats_add(unsigned long start_us)
+{
+    unsigned long us = micros() - start_us;
+    lcd_render_stats.time_us += us;
+    if (us > lcd_render_stats.max_call_us) lcd_render_stats.max_call_us = us;
+}
+
+void lcd_render_stats_reset()
+{
+    memset(&lcd_render_stats, 0, sizeof(lcd_render_stats));
+}
+
+void lcd_render_stats_report()
+{
+    unsigned long frames = max(lcd_render_stats.frames, 1);
+    SERIAL_ECHO_START;
+    SERIAL_ECHOPGM("LCD frames:");
+    SERIAL_ECHO(lcd_render_stats.frames);
+    SERIAL_ECHOPGM(" draws/frame:");
+    SERIAL_ECHO((float)lcd_render_stats.draws / frames);
+    SERIAL_ECHOPGM(" bytes/frame:");
+    SERIAL_ECHO(lcd_render_stats.bytes / frames);
+    SERIAL_ECHOPGM(" us/frame:");
+    SERIAL_ECHO(lcd_render_stats.time_us / frames);
+    SERIAL_ECHOPGM(" max us:");
+    SERIAL_ECHOLN(lcd_render_stats.max_call_us);
+}
+#endif //LCD_RENDER_STATS
+
+#ifdef DOGLCD
+// One page strip of the u8glib picture loop
+static void lcd_draw_page()
+{
+  #ifdef LCD_RENDER_STATS
+    lcd_render_stats.draws++;
+  #endif
+    u8g.setFont(u8g_font_6x10_marlin);
+    u8g.setPrintPos(125,0);
+    if (blink % 2) u8g.setColorIndex(1); else u8g.setColorIndex(0); // Set color for the alive dot
+    u8g.drawPixel(127,63); // draw alive dot
+    u8g.setColorIndex(1); // black on white
+    (*currentMenu)();
+}
+#endif
+
+#ifdef DOGLCD_SLICED_UPDATE
+static bool lcd_frame_open = false; // a picture loop is in progress, lcd_update() draws one page strip per call
+static bool lcd_in_draw = false;    // menu actions that wait for the planner call lcd_update() from inside the draw
+#else
+#define lcd_frame_open false
+#endif
+
 void lcd_update()
 {
     static unsigned long timeoutToStatus = 0;
@@ -1185,6 +1240,11 @@ void lcd_update()
 
     lcd_buttons_update();
 
+#ifdef DOGLCD_SLICED_UPDATE
+    if (lcd_in_draw)
+        return;
+#endif
+
     #if (SDCARDDETECT > 0)
     if((IS_SD_INSERTED != lcd_oldcardstatus && lcd_detected()))
     {
@@ -1195,6 +1255,9 @@ void lcd_update()
             currentMenu == lcd_status_screen
           #endif
         );
+        #ifdef DOGLCD_SLICED_UPDATE
+        lcd_frame_open = false; // the init ran a picture loop of its own, the frame starts over
+        #endif
 
         if(lcd_oldcardstatus)
         {
@@ -1209,9 +1272,18 @@ void lcd_update()
     }
     #endif//CARDINSERTED
 
-    if (lcd_next_update_millis < millis())
+#ifdef DOGLCD_SLICED_UPDATE
+    // Leave the main loop to the planner while it runs low on moves, for LCD_YIELD_MAX_MS at most
+    if ((lcd_frame_open || lcd_next_update_millis < millis()) && blocks_queued() && movesplanned() < LCD_YIELD_MOVES
+            && millis() - lcd_next_update_millis < LCD_YIELD_MAX_MS)
+        return;
+#endif
+
+    if (lcd_frame_open || lcd_next_update_millis < millis())
     {
 #ifdef ULTIPANEL
+      if (!lcd_frame_open) // once per frame
+      {
 		#ifdef REPRAPWORLD_KEYPAD
         	if (REPRAPWORLD_KEYPAD_MOVE_Z_UP) {
         		reprapworld_keypad_move_z_up();
@@ -1244,23 +1316,52 @@ void lcd_update()
         }
         if (LCD_CLICKED)
             timeoutToStatus = millis() + LCD_TIMEOUT_TO_STATUS;
+      }
 #endif//ULTIPANEL
 
+#ifdef LCD_RENDER_STATS
+        unsigned long draw_start = micros();
+#endif
 #ifdef DOGLCD        // Changes due to different driver architecture of the DOGM display
+  #ifdef DOGLCD_SLICED_UPDATE
+        if (!lcd_frame_open)
+        {
+            blink++;     // Variable for fan animation and alive dot
+            u8g.firstPage();
+            lcd_frame_open = true;
+        }
+        lcd_in_draw = true;
+        lcd_draw_page();
+        lcd_in_draw = false;
+        if (lcdDrawUpdate && u8g.nextPage())
+        {
+          #ifdef LCD_RENDER_STATS
+            lcd_render_stats_add(draw_start);
+          #endif
+            return;      // the next strip follows with the next call
+        }
+        lcd_frame_open = false;
+  #else
         blink++;     // Variable for fan animation and alive dot
         u8g.firstPage();
         do
         {
-            u8g.setFont(u8g_font_6x10_marlin);
-            u8g.setPrintPos(125,0);
-            if (blink % 2) u8g.setColorIndex(1); else u8g.setColorIndex(0); // Set color for the alive dot
-            u8g.drawPixel(127,63); // draw alive dot
-            u8g.setColorIndex(1); // black on white
-            (*currentMenu)();
+            lcd_draw_page();
             if (!lcdDrawUpdate)  break; // Terminate display update, when nothing new to draw. This must be done before the last dogm.next()
         } while( u8g.nextPage() );
+  #endif
 #else
         (*currentMenu)();
+  #ifdef HD44780_SHADOW_BUFFER
+        lcd.sendChanges();
+  #endif
+  #ifdef LCD_RENDER_STATS
+        lcd_render_stats.draws++;
+  #endif
+#endif
+#ifdef LCD_RENDER_STATS
+        lcd_render_stats_add(draw_start);
+        lcd_render_stats.frames++;
 #endif
 
 #ifdef LCD_HAS_STATUS_INDICATORS
@@ -24,6 +24,22 @@
   #define LCD_ALERTMESSAGEPGM(x) lcd_setalertstatuspgm(PSTR(x))
 
   #define LCD_UPDATE_INTERVAL 100
+
+  #ifdef LCD_RENDER_STATS
+    struct lcd_render_stats_t {
+      unsigned long frames;       // completed screen updates
+      unsigned long draws;        // calls of the menu function, one per page strip on the graphical displays
+      unsigned long bytes;        // bytes sent to the display
+      unsigned long time_us;      // time spent drawing
+      unsigned long max_call_us;  // longest drawing in a single lcd_update()
+    };
+    extern lcd_render_stats_t lcd_render_stats;
+    void lcd_render_stats_report();
+    void lcd_render_stats_reset();
+    #define LCD_STATS_BYTES(n) lcd_render_stats.bytes += (n)
+  #else
+    #define LCD_STATS_BYTES(n)
+  #endif
   #define LCD_TIMEOUT_TO_STATUS 15000
 
   #ifdef ULTIPANEL
@@ -136,6 +136,90 @@ extern volatile uint16_t buttons;  //an extended version of the last checked but
 
 #endif //ULTIPANEL
 
+#ifdef HD44780_SHADOW_BUFFER
+/**
+* Copy of the character grid in front of the LCD class. Drawing only fills the wanted grid,
+* sendChanges() then writes the characters that differ from what the display shows. A cursor
+* move is only sent where the changed characters are not next to each other.
+**/
+template<class T> class LcdShadow : public T
+{
+  public:
+    template<class A> LcdShadow(A a) : T(a), pass_through(false) {}
+    template<class A, class B> LcdShadow(A a, B b) : T(a, b), pass_through(false) {}
+    template<class A, class B, class C> LcdShadow(A a, B b, C c) : T(a, b, c), pass_through(false) {}
+    template<class A, class B, class C, class D, class E, class F> LcdShadow(A a, B b, C c, D d, E e, F f) : T(a, b, c, d, e, f), pass_through(false) {}
+    template<class A, class B, class C, class D, class E, class F, class G, class H> LcdShadow(A a, B b, C c, D d, E e, F f, G g, H h) : T(a, b, c, d, e, f, g, h), pass_through(false) {}
+
+    void setCursor(uint8_t col, uint8_t row) { cursor_col = col; cursor_row = row; }
+    void clear() { memset(wanted, ' ', sizeof(wanted)); cursor_col = cursor_row = 0; }
+
+    size_t write(uint8_t c)
+    {
+      if (pass_through) {
+        T::write(c);
+        return 1;
+      }
+      if (cursor_col < LCD_WIDTH && cursor_row < LCD_HEIGHT) wanted[cursor_row][cursor_col++] = c;
+      return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+      for (size_t n = size; n--;) write(*buffer++);
+      return size;
+    }
+    using Print::write;
+
+    // The glyph rows go through the virtual write(), they have to reach the CGRAM and not the grid
+    template<class C> void createChar(uint8_t location, C charmap)
+    {
+      pass_through = true;
+      T::createChar(location, charmap);
+      pass_through = false;
+    }
+
+    // The display content is unknown, after begin() or a reconnect. Clear both grids.
+    void reset()
+    {
+      T::clear();
+      memset(shown, ' ', sizeof(shown));
+      clear();
+    }
+
+    void sendChanges()
+    {
+      for (uint8_t row = 0; row < LCD_HEIGHT; row++)
+      {
+        bool in_place = false; // the display cursor is at this character
+        for (uint8_t col = 0; col < LCD_WIDTH; col++)
+        {
+          if (wanted[row][col] == shown[row][col]) {
+            in_place = false;
+            continue;
+          }
+          if (!in_place) {
+            T::setCursor(col, row);
+            LCD_STATS_BYTES(1);
+            in_place = true;
+          }
+          T::write(wanted[row][col]);
+          LCD_STATS_BYTES(1);
+          shown[row][col] = wanted[row][col];
+        }
+      }
+    }
+
+  private:
+    char wanted[LCD_HEIGHT][LCD_WIDTH]; // drawn by the menus
+    char shown[LCD_HEIGHT][LCD_WIDTH];  // on the display
+    uint8_t cursor_col, cursor_row;
+    bool pass_through; // write() goes straight to the display
+};
+  #define LCD_INSTANCE_CLASS LcdShadow<LCD_CLASS>
+#else
+  #define LCD_INSTANCE_CLASS LCD_CLASS
+#endif //HD44780_SHADOW_BUFFER
+
 ////////////////////////////////////
 // Create LCD class instance and chipset-specific information
 #if defined(LCD_I2C_TYPE_PCF8575)
@@ -153,7 +237,7 @@ extern volatile uint16_t buttons;  //an extended version of the last checked but
   #include <LCD.h>
   #include <LiquidCrystal_I2C.h>
   #define LCD_CLASS LiquidCrystal_I2C
-  LCD_CLASS lcd(LCD_I2C_ADDRESS,LCD_I2C_PIN_EN,LCD_I2C_PIN_RW,LCD_I2C_PIN_RS,LCD_I2C_PIN_D4,LCD_I2C_PIN_D5,LCD_I2C_PIN_D6,LCD_I2C_PIN_D7);
+  LCD_INSTANCE_CLASS lcd(LCD_I2C_ADDRESS,LCD_I2C_PIN_EN,LCD_I2C_PIN_RW,LCD_I2C_PIN_RS,LCD_I2C_PIN_D4,LCD_I2C_PIN_D5,LCD_I2C_PIN_D6,LCD_I2C_PIN_D7);
   
 #elif defined(LCD_I2C_TYPE_MCP23017)
   //for the LED indicators (which maybe mapped to different things in lcd_implementation_update_indicators())
@@ -167,9 +251,9 @@ extern volatile uint16_t buttons;  //an extended version of the last checked but
   #include <LiquidTWI2.h>
   #define LCD_CLASS LiquidTWI2
   #if defined(DETECT_DEVICE)
-     LCD_CLASS lcd(LCD_I2C_ADDRESS, 1);
+     LCD_INSTANCE_CLASS lcd(LCD_I2C_ADDRESS, 1);
   #else
-     LCD_CLASS lcd(LCD_I2C_ADDRESS);
+     LCD_INSTANCE_CLASS lcd(LCD_I2C_ADDRESS);
   #endif
   
 #elif defined(LCD_I2C_TYPE_MCP23008)
@@ -177,15 +261,15 @@ extern volatile uint16_t buttons;  //an extended version of the last checked but
   #include <LiquidTWI2.h>
   #define LCD_CLASS LiquidTWI2
   #if defined(DETECT_DEVICE)
-     LCD_CLASS lcd(LCD_I2C_ADDRESS, 1);
+     LCD_INSTANCE_CLASS lcd(LCD_I2C_ADDRESS, 1);
   #else
-     LCD_CLASS lcd(LCD_I2C_ADDRESS);
+     LCD_INSTANCE_CLASS lcd(LCD_I2C_ADDRESS);
   #endif
 
 #elif defined(LCD_I2C_TYPE_PCA8574)
     #include <LiquidCrystal_I2C.h>
     #define LCD_CLASS LiquidCrystal_I2C
-    LCD_CLASS lcd(LCD_I2C_ADDRESS, LCD_WIDTH, LCD_HEIGHT);
+    LCD_INSTANCE_CLASS lcd(LCD_I2C_ADDRESS, LCD_WIDTH, LCD_HEIGHT);
     
 // 2 wire Non-latching LCD SR from:
 // https://bitbucket.org/fmalpartida/new-liquidcrystal/wiki/schematics#!shiftregister-connection 
@@ -195,7 +279,7 @@ extern volatile uint16_t buttons;  //an extended version of the last checked but
   #include <LCD.h>
   #include <LiquidCrystal_SR.h>
   #define LCD_CLASS LiquidCrystal_SR
-  LCD_CLASS lcd(SR_DATA_PIN, SR_CLK_PIN);
+  LCD_INSTANCE_CLASS lcd(SR_DATA_PIN, SR_CLK_PIN);
 
 #else
   // Standard directly connected LCD implementations
@@ -206,7 +290,7 @@ extern volatile uint16_t buttons;  //an extended version of the last checked but
     #include <LiquidCrystal.h>
     #define LCD_CLASS LiquidCrystal
   #endif  
-  LCD_CLASS lcd(LCD_PINS_RS, LCD_PINS_ENABLE, LCD_PINS_D4, LCD_PINS_D5,LCD_PINS_D6,LCD_PINS_D7);  //RS,Enable,D4,D5,D6,D7
+  LCD_INSTANCE_CLASS lcd(LCD_PINS_RS, LCD_PINS_ENABLE, LCD_PINS_D4, LCD_PINS_D5,LCD_PINS_D6,LCD_PINS_D7);  //RS,Enable,D4,D5,D6,D7
 #endif
 
 #if defined(LCD_PROGRESS_BAR) && defined(SDSUPPORT)
@@ -410,11 +494,15 @@ static void lcd_implementation_init(
         #endif
     );
 
+#ifdef HD44780_SHADOW_BUFFER
+    lcd.reset();
+#else
     lcd.clear();
+#endif
 }
 static void lcd_implementation_clear()
 {
-    lcd.clear();
+    lcd.clear(); // with HD44780_SHADOW_BUFFER only the wanted grid, the next redraw sends the difference
 }
 /* Arduino < 1.0.0 is missing a function to print PROGMEM strings, so we need to implement our own */
 static void lcd_printPGM(const char* str)
@@ -20,6 +20,7 @@
 #define HEIGHT 64
 
 #include <U8glib.h>
+#include "dogm_dirty_tiles.h"
 
 static void ST7920_SWSPI_SND_8BIT(uint8_t val)
 {
@@ -84,6 +85,32 @@ uint8_t u8g_dev_rrd_st7920_128x64_fn(u8g_t *u8g, u8g_dev_t *dev, uint8_t msg, vo
         y = pb->p.page_y0;
         ptr = (uint8_t*)pb->buf;
 
+#ifdef DOGLCD_DIRTY_TILES
+        // The GDRAM is addressed in 16 pixel words, one tile wide. Send the changed run of each row.
+        uint8_t first = 0, last = 0, changed = 0;
+        ST7920_CS();
+        for( i = 0; i < PAGE_HEIGHT; i ++ )
+        {
+          if ( (i % DOG_TILE_HEIGHT) == 0 )
+          {
+            changed = dog_tiles_changed(y / DOG_TILE_HEIGHT, ptr, 2, 2, DOG_TILE_HEIGHT, WIDTH/8);
+            if ( changed ) dog_tiles_span(changed, first, last);
+          }
+          if ( changed )
+          {
+            uint8_t *run = ptr + 2*first;
+            ST7920_SET_CMD();
+            ST7920_WRITE_BYTE(0x80 | (y & 31));                  //y
+            ST7920_WRITE_BYTE(0x80 | (y < 32 ? 0 : 8) | first);  //x in words
+            ST7920_SET_DAT();
+            ST7920_WRITE_BYTES(run,2*(last-first+1));            //run is incremented inside of macro
+            LCD_STATS_BYTES(2 + 2*(last-first+1));
+          }
+          ptr += WIDTH/8;
+          y++;
+        }
+        ST7920_NCS();
+#else
         ST7920_CS();
         for( i = 0; i < PAGE_HEIGHT; i ++ )
         {
@@ -101,9 +128,11 @@ uint8_t u8g_dev_rrd_st7920_128x64_fn(u8g_t *u8g, u8g_dev_t *dev, uint8_t msg, vo
 
           ST7920_SET_DAT();
           ST7920_WRITE_BYTES(ptr,WIDTH/8); //ptr is incremented inside of macro
+          LCD_STATS_BYTES(2 + WIDTH/8);
           y++;
         }
         ST7920_NCS();
+#endif
       }
       break;
   }